@@ -0,0 +1,506 @@
+#include "Bytecode.h"
+#include "CodeGen.h"
+#include "JIT.h"
+#include "LLVMCompat.h"
+#include "Parser.h"
+#include "Sema.h"
+#include "Simplify.h"
+#include "StreamCompiler.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+
+/* calc-bench runs the phases of calc one after the other on a generated
+ * (or given) expression and reports the time and the heap allocations of
+ * each phase as JSON, so that results of different builds can be diffed.
+ */
+
+ static llvm::cl::opt<unsigned> Size("size", llvm::cl::desc("Number of operands of the generated expression"), llvm::cl::init(10000));
+
+ static llvm::cl::opt<unsigned> Depth("depth", llvm::cl::desc("Maximum parenthesis nesting of the generated expression"), llvm::cl::init(16));
+
+ static llvm::cl::opt<unsigned> Vars("vars", llvm::cl::desc("Number of variables of the generated expression"), llvm::cl::init(8));
+
+ // The shape of the generated expression
+ enum Shape { RandomShape, DeepShape, WideShape };
+ static llvm::cl::opt<Shape> ExprShape("shape", llvm::cl::desc("Shape of the generated expression"),
+                                       llvm::cl::values(clEnumValN(RandomShape, "random", "Random grouping up to -depth levels (default)"),
+                                                        clEnumValN(DeepShape, "deep", "a + (b * (c - (...))), nested once per operand"),
+                                                        clEnumValN(WideShape, "wide", "a + b * c - ..., without any parentheses")),
+                                       llvm::cl::init(RandomShape));
+
+ static llvm::cl::opt<Parser::Strategy> ParserStrategy("parser", llvm::cl::desc("How expressions are parsed"),
+                                                       llvm::cl::values(clEnumValN(Parser::RecursiveDescent, "recursive", "Recursive descent (default)"),
+                                                                        clEnumValN(Parser::OperatorPrecedence, "climb", "Iterative precedence climbing")),
+                                                       llvm::cl::init(Parser::RecursiveDescent));
+
+ static llvm::cl::opt<bool> ParseOnly("parse-only", llvm::cl::desc("Stop after parsing; the later phases recurse over the tree depth"));
+
+ static llvm::cl::opt<bool> Stream("stream", llvm::cl::desc("Also time the whole pipeline from the text to the module, once with the "
+                                                            "separate phases and once with the StreamCompiler"));
+
+ static llvm::cl::opt<bool> Tier("tier", llvm::cl::desc("Also time the interpreter and the JIT of calc::Engine, and report after "
+                                                        "how many evaluations the JIT pays off"));
+
+ static llvm::cl::opt<unsigned> TierEvals("tier-evals", llvm::cl::desc("Number of evaluations timed with -tier"), llvm::cl::init(100000));
+
+ static llvm::cl::opt<unsigned> TierOptLevel("tier-O", llvm::cl::desc("Optimization level of the JIT with -tier"), llvm::cl::init(2));
+
+ static llvm::cl::opt<unsigned> Seed("seed", llvm::cl::desc("Seed of the expression generator"), llvm::cl::init(1));
+
+ static llvm::cl::opt<unsigned> Repeat("repeat", llvm::cl::desc("Number of runs; the fastest run of each phase is reported"), llvm::cl::init(5));
+
+ static llvm::cl::opt<bool> Fold("fold", llvm::cl::desc("Include the simplification phase"), llvm::cl::init(true));
+
+ static llvm::cl::opt<std::string> InputFile("input", llvm::cl::desc("Benchmark the expression in this file instead of a generated one"),
+                                             llvm::cl::value_desc("filename"));
+
+ static llvm::cl::opt<bool> PrintExpr("print-expr", llvm::cl::desc("Print the generated expression instead of benchmarking it"));
+
+// Counts every allocation with the global operator new, including those of
+// LLVM, e.g. the slabs of the AST arena and the IR objects
+ static size_t AllocatedBytes = 0;
+ static size_t Allocations = 0;
+
+ static void *countedAlloc(size_t Size, size_t Alignment = 0){
+    AllocatedBytes += Size;
+    ++Allocations;
+    void *P = Alignment ? std::aligned_alloc(Alignment, (Size + Alignment - 1) / Alignment * Alignment)
+                        : std::malloc(Size ? Size : 1);
+    if (!P)
+        throw std::bad_alloc();
+    return P;
+ }
+
+void *operator new(size_t Size) { return countedAlloc(Size); }
+void *operator new[](size_t Size) { return countedAlloc(Size); }
+void *operator new(size_t Size, std::align_val_t Al) { return countedAlloc(Size, static_cast<size_t>(Al)); }
+void *operator new[](size_t Size, std::align_val_t Al) { return countedAlloc(Size, static_cast<size_t>(Al)); }
+void operator delete(void *P) noexcept { std::free(P); }
+void operator delete[](void *P) noexcept { std::free(P); }
+void operator delete(void *P, size_t) noexcept { std::free(P); }
+void operator delete[](void *P, size_t) noexcept { std::free(P); }
+void operator delete(void *P, std::align_val_t) noexcept { std::free(P); }
+void operator delete[](void *P, std::align_val_t) noexcept { std::free(P); }
+void operator delete(void *P, size_t, std::align_val_t) noexcept { std::free(P); }
+void operator delete[](void *P, size_t, std::align_val_t) noexcept { std::free(P); }
+
+namespace {
+    // Generates random expressions. The lexer only accepts letters in
+    // identifiers, so variable I is named by I in base 26 with the digits
+    // a to z.
+    class ExprGenerator{
+        std::mt19937 Gen;
+        std::vector<std::string> Names;
+        std::string Out;
+
+        unsigned random(unsigned N) { return std::uniform_int_distribution<unsigned>(0, N - 1)(Gen); }
+
+        void operand(){
+            if (Names.empty() || random(4) == 0)
+                Out += std::to_string(1 + random(100));
+            else
+                Out += Names[random(Names.size())];
+        }
+
+        void op(){
+            static const char *Ops[] = {" + ", " - ", " * ", " / "};
+            // Divisions are rare, as they cannot be vectorized
+            Out += Ops[random(16) == 0 ? 3 : random(3)];
+        }
+
+        // Emits N operands. Below the maximum nesting, parts of the operands
+        // are grouped into parenthesized subexpressions.
+        void expr(unsigned N, unsigned Level){
+            while (N){
+                unsigned Take = N;
+                if (Level < Depth && N > 1)
+                    Take = 1 + random(N);
+                if (Take > 1 && Level < Depth){
+                    Out += "(";
+                    expr(Take, Level + 1);
+                    Out += ")";
+                } else {
+                    operand();
+                    Take = 1;
+                }
+                N -= Take;
+                if (N)
+                    op();
+            }
+        }
+
+        // Emits N operands, each but the last followed by an operator and an
+        // opening parenthesis
+        void deep(unsigned N){
+            for (unsigned I = 1; I < N; ++I){
+                operand();
+                op();
+                Out += "(";
+            }
+            operand();
+            Out.append(N - 1, ')');
+        }
+
+    public:
+        ExprGenerator(unsigned Seed, unsigned NumVars) : Gen(Seed){
+            for (unsigned I = 0; Names.size() < NumVars; ++I){
+                std::string Name;
+                for (unsigned V = I;; V = V / 26 - 1){
+                    Name.insert(Name.begin(), 'a' + V % 26);
+                    if (V < 26)
+                        break;
+                }
+                if (Name != "with")
+                    Names.push_back(Name);
+            }
+        }
+
+        std::string generate(unsigned NumOperands, Shape S){
+            Out.clear();
+            if (!Names.empty()){
+                Out += "with ";
+                for (size_t I = 0; I < Names.size(); ++I)
+                    Out += (I ? "," : "") + Names[I];
+                Out += ": ";
+            }
+            NumOperands = std::max(1u, NumOperands);
+            if (S == DeepShape)
+                deep(NumOperands);
+            else if (S == WideShape)
+                expr(NumOperands, Depth); // Already at the maximum nesting
+            else
+                expr(NumOperands, 0);
+            return Out;
+        }
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    // The measurements of one phase over all runs
+    struct Phase{
+        const char *Name;
+        double BestMs = 0;
+        size_t Bytes = 0;
+        size_t Allocs = 0;
+        unsigned Runs = 0;
+    };
+
+    // Runs F as the phase P and records its time and allocations
+    template <typename Fn>
+    void measure(Phase &P, Fn F){
+        size_t Bytes = AllocatedBytes, Allocs = Allocations;
+        Clock::time_point Start = Clock::now();
+        F();
+        double Ms = std::chrono::duration<double, std::milli>(Clock::now() - Start).count();
+        P.BestMs = P.Runs++ ? std::min(P.BestMs, Ms) : Ms;
+        P.Bytes = AllocatedBytes - Bytes;
+        P.Allocs = Allocations - Allocs;
+    }
+
+    // Rows of variable values for -tier. Rows which divide by zero are
+    // dropped, so that every evaluation computes the whole expression.
+    std::vector<int32_t> makeRows(const Bytecode &Code, unsigned NumRows, unsigned Seed){
+        std::mt19937 Gen(Seed);
+        std::uniform_int_distribution<int32_t> Dist(-100, 100);
+        std::vector<int32_t> Rows, Row(Code.getNumVars());
+        for (unsigned Tries = 0; Tries < NumRows * 4 && Rows.size() < NumRows * Row.size(); ++Tries){
+            for (int32_t &V : Row)
+                V = Dist(Gen);
+            int32_t Result;
+            if (Code.eval(Row.data(), Result))
+                Rows.insert(Rows.end(), Row.begin(), Row.end());
+        }
+        return Rows;
+    }
+
+    // Rows of values near the ends of the int32 range, on which most
+    // operations overflow. Unlike makeRows(), the rows which divide by zero
+    // or INT_MIN by -1 are kept.
+    std::vector<int32_t> makeOverflowRows(unsigned NumVars, unsigned NumRows, unsigned Seed){
+        static const int32_t Values[] = {INT32_MIN, INT32_MIN + 1, -1500000000, -1, 0, 1, 1500000000, INT32_MAX};
+        std::mt19937 Gen(Seed);
+        std::uniform_int_distribution<unsigned> Dist(0, std::size(Values) - 1);
+        std::vector<int32_t> Rows(NumVars * NumRows);
+        for (int32_t &V : Rows)
+            V = Values[Dist(Gen)];
+        return Rows;
+    }
+
+    // Evaluates F on N rows, cycling through Rows
+    template <typename Fn>
+    int32_t evalRows(const std::vector<int32_t> &Rows, unsigned NumVars, unsigned N, Fn F){
+        size_t NumRows = NumVars ? Rows.size() / NumVars : 1;
+        int32_t Sum = 0;
+        for (unsigned I = 0, Row = 0; I < N; ++I, Row = Row + 1 == NumRows ? 0 : Row + 1)
+            Sum += F(Rows.data() + Row * NumVars);
+        return Sum;
+    }
+
+    // Counts the nodes of a tree, visiting shared nodes once per use
+    class NodeCounter : public ASTVisitor{
+    public:
+        size_t Count = 0;
+        virtual void visit(Factor &) override { ++Count; }
+        virtual void visit(BinaryOp &Node) override {
+            ++Count;
+            Node.getLeft()->accept(*this);
+            Node.getRight()->accept(*this);
+        }
+        virtual void visit(WithDecl &Node) override {
+            ++Count;
+            for (Expr *E : Node.getExprs())
+                E->accept(*this);
+        }
+    };
+} // unnamed namespace
+
+ int main(int argc, const char **argv){
+    llvm::InitLLVM X(argc, argv);
+    llvm::cl::ParseCommandLineOptions(argc, argv, "calc-bench - times the phases of calc\n");
+    compat::enableOpaquePointers();
+
+    if (TierOptLevel > 3){
+        llvm::errs() << "calc-bench: invalid optimization level -tier-O=" << TierOptLevel << "\n";
+        return 1;
+    }
+
+    std::string Input;
+    if (InputFile.empty()){
+        Input = ExprGenerator(Seed, Vars).generate(Size, ExprShape);
+    } else {
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buffer = llvm::MemoryBuffer::getFileOrSTDIN(InputFile);
+        if (!Buffer){
+            llvm::errs() << "calc-bench: cannot read " << InputFile << ": " << Buffer.getError().message() << "\n";
+            return 1;
+        }
+        Input = (*Buffer)->getBuffer().str();
+    }
+    if (PrintExpr){
+        llvm::outs() << Input << "\n";
+        return 0;
+    }
+
+    Phase Lex{"lex"}, Parse{"parse"}, Check{"sema"}, Simplify{"simplify"}, IRGen{"irgen"}, Print{"print"};
+    Phase Pipeline{"pipeline"}, StreamPhase{"stream"};
+    Phase Lower{"bytecode"}, Interpret{"interpret"}, JITPhase{"jit"}, Native{"native"};
+    size_t Tokens = 0, Nodes = 0, IRBytes = 0;
+
+    // Like calc::Engine, which is not part of calcCore: one JIT for all
+    // runs and a target machine for the host
+    std::unique_ptr<CalcJIT> JIT;
+    std::unique_ptr<llvm::TargetMachine> TM;
+    if (Tier){
+        llvm::ExitOnError ExitOnErr("calc-bench: ");
+        JIT = ExitOnErr(CalcJIT::create());
+        TM = ExitOnErr(ExitOnErr(llvm::orc::JITTargetMachineBuilder::detectHost()).createTargetMachine());
+    }
+    volatile int32_t Sink = 0; // Keeps the evaluations from being optimized away
+    for (unsigned Run = 0; Run < std::max(1u, Repeat.getValue()); ++Run){
+        measure(Lex, [&]{
+            Lexer Lex(Input);
+            Token Tok;
+            Tokens = 0;
+            do {
+                Lex.next(Tok);
+                ++Tokens;
+            } while (!Tok.is(Token::eoi));
+        });
+
+        // The AST and the module are freed outside of the measured phases
+        ASTContext ASTCtx;
+        AST *Tree = nullptr;
+        bool HasError = false;
+        measure(Parse, [&]{
+            Lexer Lex(Input);
+            Parser Parser(Lex, ASTCtx);
+            Parser.setStrategy(ParserStrategy);
+            Tree = Parser.parse();
+            HasError = !Tree || Parser.hasError();
+        });
+        if (HasError){
+            llvm::errs() << "calc-bench: syntax errors occured\n";
+            return 1;
+        }
+        if (ParseOnly){
+            Nodes = ASTCtx.getNumNodes();
+            continue;
+        }
+        measure(Check, [&]{ HasError = Sema().semantic(Tree); });
+        if (HasError){
+            llvm::errs() << "calc-bench: semantic errors occured\n";
+            return 1;
+        }
+        NodeCounter Counter;
+        Tree->accept(Counter);
+        Nodes = Counter.Count;
+        if (Fold)
+            measure(Simplify, [&]{ Tree = Simplifier(ASTCtx).simplify(Tree); });
+
+        llvm::LLVMContext Ctx;
+        std::unique_ptr<llvm::Module> M;
+        measure(IRGen, [&]{ M = CodeGen().compile(Tree, Ctx); });
+        std::string IR;
+        measure(Print, [&]{
+            llvm::raw_string_ostream OS(IR);
+            M->print(OS, nullptr);
+        });
+        IRBytes = IR.size();
+
+        if (Stream){
+            // End to end, including the creation of the AST arena, so that
+            // the costs the streaming compiler avoids are all counted
+            std::unique_ptr<llvm::Module> PipelineM, StreamM;
+            measure(Pipeline, [&]{
+                ASTContext ASTCtx;
+                Lexer Lex(Input);
+                Parser Parser(Lex, ASTCtx);
+                Parser.setStrategy(ParserStrategy);
+                AST *Tree = Parser.parse();
+                Sema().semantic(Tree);
+                if (Fold)
+                    Tree = Simplifier(ASTCtx).simplify(Tree);
+                PipelineM = CodeGen().compile(Tree, Ctx);
+            });
+            measure(StreamPhase, [&]{ StreamM = StreamCompiler().compile(Input, Ctx); });
+        }
+
+        if (Tier){
+            // The phases of a handle of calc::Engine: lowering when it is
+            // compiled, and the JIT when it is promoted
+            Bytecode Code;
+            measure(Lower, [&]{ Code = Bytecode::compile(Tree); });
+            if (Code.getNumResults() != 1){
+                llvm::errs() << "calc-bench: -tier needs an expression with a single result\n";
+                return 1;
+            }
+            std::vector<int32_t> Rows = makeRows(Code, 1024, Seed);
+            if (Code.getNumVars() && Rows.empty()){
+                llvm::errs() << "calc-bench: the expression divides by zero for all values\n";
+                return 1;
+            }
+            measure(Interpret, [&]{
+                Sink = evalRows(Rows, Code.getNumVars(), TierEvals, [&](const int32_t *Vars){
+                    int32_t Result = 0;
+                    Code.eval(Vars, Result);
+                    return Result;
+                });
+            });
+
+            // Compiles the checked function calc::Engine promotes expressions to, so
+            // that the timing includes the division checks
+            using FnTy = bool(const int32_t *, int32_t *);
+            FnTy *Fn = nullptr;
+            std::string Name = "calc_fn_" + std::to_string(Run);
+            llvm::Error Err = llvm::Error::success();
+            measure(JITPhase, [&]{
+                auto JITCtx = std::make_unique<llvm::LLVMContext>();
+                auto JITM = std::make_unique<llvm::Module>("calc.bench", *JITCtx);
+                JITM->setDataLayout(TM->createDataLayout());
+                JITM->setTargetTriple(TM->getTargetTriple().getTriple());
+                CodeGen CodeGenerator(TM.get());
+                CodeGenerator.compileResultsFunction(Tree, *JITM, Name);
+                CodeGenerator.optimize(*JITM, TierOptLevel);
+                if ((Err = JIT->addModule(std::move(JITM), std::move(JITCtx))))
+                    return;
+                llvm::Expected<FnTy *> F = JIT->lookupFunction<FnTy>(Name);
+                if (!F)
+                    Err = F.takeError();
+                else
+                    Fn = *F;
+            });
+            if (Err){
+                llvm::errs() << "calc-bench: " << llvm::toString(std::move(Err)) << "\n";
+                return 1;
+            }
+            // Promoting a handle must not change its results, so both tiers
+            // have to agree, also where the operations overflow
+            std::vector<int32_t> CheckRows = makeOverflowRows(Code.getNumVars(), 1024, Seed);
+            CheckRows.insert(CheckRows.end(), Rows.begin(), Rows.end());
+            size_t NumCheckRows = Code.getNumVars() ? CheckRows.size() / Code.getNumVars() : 1;
+            for (size_t Row = 0; Row < NumCheckRows; ++Row){
+                const int32_t *RowVars = CheckRows.data() + Row * Code.getNumVars();
+                int32_t Interpreted = 0, Compiled = 0;
+                bool InterpretedOk = Code.eval(RowVars, Interpreted);
+                bool CompiledOk = Fn(RowVars, &Compiled);
+                if (InterpretedOk != CompiledOk || Interpreted != Compiled){
+                    llvm::errs() << "calc-bench: the interpreter and the JIT disagree in row " << Row << "\n";
+                    return 1;
+                }
+            }
+            measure(Native, [&]{
+                Sink = evalRows(Rows, Code.getNumVars(), TierEvals, [&](const int32_t *Vars){
+                    int32_t Result = 0;
+                    Fn(Vars, &Result);
+                    return Result;
+                });
+            });
+        }
+    }
+    (void)Sink;
+
+    llvm::json::OStream J(llvm::outs(), /*IndentSize=*/2);
+    J.object([&]{
+        J.attributeObject("input", [&]{
+            if (InputFile.empty()){
+                J.attribute("shape", ExprShape == DeepShape ? "deep" : ExprShape == WideShape ? "wide" : "random");
+                J.attribute("size", Size.getValue());
+                J.attribute("depth", Depth.getValue());
+                J.attribute("vars", Vars.getValue());
+                J.attribute("seed", Seed.getValue());
+            } else {
+                J.attribute("file", InputFile.getValue());
+            }
+            J.attribute("bytes", static_cast<int64_t>(Input.size()));
+            J.attribute("tokens", static_cast<int64_t>(Tokens));
+            J.attribute("nodes", static_cast<int64_t>(Nodes));
+            J.attribute("ir_bytes", static_cast<int64_t>(IRBytes));
+        });
+        J.attribute("runs", std::max(1u, Repeat.getValue()));
+        J.attribute("parser", ParserStrategy == Parser::OperatorPrecedence ? "climb" : "recursive");
+        J.attributeArray("phases", [&]{
+            for (Phase *P : {&Lex, &Parse, &Check, &Simplify, &IRGen, &Print, &Pipeline, &StreamPhase, &Lower, &Interpret,
+                             &JITPhase, &Native}){
+                if (!P->Runs)
+                    continue;
+                J.object([&]{
+                    J.attribute("name", P->Name);
+                    J.attribute("ms", P->BestMs);
+                    J.attribute("nodes_per_sec", P->BestMs > 0 ? Nodes / (P->BestMs / 1000.0) : 0.0);
+                    J.attribute("bytes_allocated", static_cast<int64_t>(P->Bytes));
+                    J.attribute("allocations", static_cast<int64_t>(P->Allocs));
+                });
+            }
+        });
+        if (Tier && Interpret.Runs){
+            // Both tiers lower the expression first. Then interpreting N
+            // evaluations costs N * interpret, and promoting costs
+            // jit + N * native, so the JIT pays off after
+            // jit / (interpret - native) evaluations
+            double InterpretNs = Interpret.BestMs * 1e6 / TierEvals, NativeNs = Native.BestMs * 1e6 / TierEvals;
+            J.attributeObject("tier", [&]{
+                J.attribute("evals", TierEvals.getValue());
+                J.attribute("opt_level", TierOptLevel.getValue());
+                J.attribute("interpret_ns_per_eval", InterpretNs);
+                J.attribute("native_ns_per_eval", NativeNs);
+                if (InterpretNs > NativeNs)
+                    J.attribute("crossover_evals",
+                                static_cast<int64_t>(std::ceil(JITPhase.BestMs * 1e6 / (InterpretNs - NativeNs))));
+                else
+                    J.attribute("crossover_evals", nullptr);
+            });
+        }
+    });
+    llvm::outs() << "\n";
+    return 0;
+ }
@@ -1,5 +1,7 @@
 #ifndef AST_H
 # define AST_H
+#include "ASTContext.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 class AST;
@@ -20,6 +22,15 @@ class AST{
     public:
     virtual ~AST(){}
     virtual void accept(ASTVisitor &V) = 0;
+
+    // Nodes are only created inside an ASTContext, with new (Ctx) Node(...)
+    void *operator new(size_t Size, ASTContext &Ctx, size_t Alignment = alignof(void *)){
+        return Ctx.allocateNode(Size, Alignment);
+    }
+    void *operator new(size_t) = delete;
+    // The arena owns the memory, so there is nothing to release per node
+    void operator delete(void *, ASTContext &, size_t) noexcept {}
+    void operator delete(void *) noexcept {}
 };
 
 class Expr : public AST{
@@ -32,11 +43,13 @@ class Factor : public Expr{
     enum ValueKind {Ident, Number};
     private:
     ValueKind Kind;
+    unsigned ID; // The identifier ID from the ASTContext, for Kind == Ident
     llvm::StringRef Val;
     public:
-    Factor(ValueKind Kind, llvm::StringRef Val) : Kind(Kind), Val(Val){}
+    Factor(ValueKind Kind, llvm::StringRef Val, unsigned ID = 0) : Kind(Kind), ID(ID), Val(Val){}
     ValueKind getKind() { return Kind; }
     llvm::StringRef getVal() { return Val; }
+    unsigned getID() { return ID; }
     virtual void accept(ASTVisitor &V) override {
         V.visit(*this);
     }
@@ -59,18 +72,40 @@ class BinaryOp : public Expr{
     }
 };
 
+// The declared variables and the expressions computing the results. A
+// tree with several results has a WithDecl at its root even if it declares
+// no variables.
 class WithDecl : public AST {
-    using VarVector = llvm::SmallVector<llvm::StringRef, 8>;
-    VarVector Vars;
-    Expr *E;
+    using VarVector = llvm::ArrayRef<llvm::StringRef>;
+    VarVector Vars; // Points into the ASTContext
+    llvm::ArrayRef<unsigned> IDs; // The identifier IDs of Vars, also in the ASTContext
+    llvm::ArrayRef<Expr *> Exprs; // The results in source order, also in the ASTContext
     public:
-    WithDecl(VarVector Vars, Expr *E) : Vars(Vars), E(E) {}
-    VarVector::const_iterator begin() { return Vars.begin(); }
-    VarVector::const_iterator end() { return Vars.end(); }
-    Expr *getExpr() { return E; }
+    WithDecl(VarVector Vars, llvm::ArrayRef<unsigned> IDs, llvm::ArrayRef<Expr *> Exprs)
+        : Vars(Vars), IDs(IDs), Exprs(Exprs) {}
+    VarVector::iterator begin() { return Vars.begin(); }
+    VarVector::iterator end() { return Vars.end(); }
+    llvm::ArrayRef<unsigned> getIDs() { return IDs; }
+    llvm::ArrayRef<Expr *> getExprs() { return Exprs; }
     virtual void accept(ASTVisitor &V) override {
         V.visit(*this);
     }
 };
 
+// Splits a tree into the declared variables and the expressions computing the results
+class DeclCollector : public ASTVisitor{
+    public:
+    llvm::SmallVector<llvm::StringRef, 8> Vars;
+    llvm::SmallVector<unsigned, 8> IDs;
+    llvm::SmallVector<Expr *, 1> Exprs;
+
+    virtual void visit(Factor &Node) override { Exprs.assign(1, &Node); }
+    virtual void visit(BinaryOp &Node) override { Exprs.assign(1, &Node); }
+    virtual void visit(WithDecl &Node) override {
+        Vars.assign(Node.begin(), Node.end());
+        IDs.assign(Node.getIDs().begin(), Node.getIDs().end());
+        Exprs.assign(Node.getExprs().begin(), Node.getExprs().end());
+    }
+};
+
 #endif
\ No newline at end of file
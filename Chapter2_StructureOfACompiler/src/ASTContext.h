@@ -0,0 +1,84 @@
+#ifndef ASTCONTEXT_H
+#define ASTCONTEXT_H
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <vector>
+
+// Owns the memory of all AST nodes of a compilation. The nodes are placed in
+// a bump-pointer arena, which makes an allocation a pointer increment, and
+// the whole tree is released at once when the context is destroyed. Node
+// destructors are never run, so nodes must not own heap memory themselves.
+//
+// The context also interns the identifiers: every distinct name gets a
+// dense ID, starting at 0, so the later phases can keep per-variable data
+// in vectors and bit sets instead of hashing names.
+class ASTContext{
+    llvm::BumpPtrAllocator Allocator;
+    unsigned NumNodes = 0;
+    llvm::StringMap<unsigned> IdentifierIDs;
+    std::vector<llvm::StringRef> IdentifierNames;
+
+    public:
+    ASTContext() = default;
+    ASTContext(const ASTContext &) = delete;
+    ASTContext &operator=(const ASTContext &) = delete;
+
+    // Used by the placement form of operator new of the AST nodes
+    void *allocateNode(size_t Size, size_t Alignment){
+        ++NumNodes;
+        return Allocator.Allocate(Size, llvm::Align(Alignment));
+    }
+
+    // Copies the elements into the arena, e.g. to turn a list built on the
+    // stack into one owned by the tree
+    template<typename T>
+    llvm::ArrayRef<T> copy(llvm::ArrayRef<T> Elements){
+        if (Elements.empty())
+            return {};
+        T *Mem = Allocator.Allocate<T>(Elements.size());
+        std::uninitialized_copy(Elements.begin(), Elements.end(), Mem);
+        return llvm::ArrayRef<T>(Mem, Elements.size());
+    }
+
+    // Copies the characters into the arena, for text which is not part of
+    // the input, e.g. the value of a folded constant
+    llvm::StringRef copyString(llvm::StringRef S){
+        if (S.empty())
+            return {};
+        char *Mem = Allocator.Allocate<char>(S.size());
+        std::uninitialized_copy(S.begin(), S.end(), Mem);
+        return llvm::StringRef(Mem, S.size());
+    }
+
+    // Returns the ID of Name, assigning the next free one to a new name
+    unsigned getIdentifierID(llvm::StringRef Name){
+        auto Inserted = IdentifierIDs.try_emplace(Name, IdentifierNames.size());
+        if (Inserted.second)
+            IdentifierNames.push_back(Inserted.first->getKey());
+        return Inserted.first->second;
+    }
+    llvm::StringRef getIdentifierName(unsigned ID) const { return IdentifierNames[ID]; }
+    unsigned getNumIdentifiers() const { return IdentifierNames.size(); }
+
+    unsigned getNumNodes() const { return NumNodes; }
+    size_t getBytesAllocated() const { return Allocator.getBytesAllocated(); }
+    size_t getTotalMemory() const { return Allocator.getTotalMemory(); }
+
+    void printStats(llvm::raw_ostream &OS) const {
+        OS << "AST statistics:\n";
+        OS << "  nodes:          " << NumNodes << "\n";
+        OS << "  bytes used:     " << getBytesAllocated();
+        if (NumNodes)
+            OS << llvm::format(" (%.1f bytes/node)", double(getBytesAllocated()) / NumNodes);
+        OS << "\n";
+        OS << "  identifiers:    " << getNumIdentifiers() << "\n";
+        OS << "  arena memory:   " << getTotalMemory() << " bytes in "
+           << Allocator.GetNumSlabs() << " slab(s)\n";
+    }
+};
+
+#endif
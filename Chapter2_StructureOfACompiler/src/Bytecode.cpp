@@ -0,0 +1,157 @@
+#include "Bytecode.h"
+#include "llvm/ADT/DenseMap.h"
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <iterator>
+#include <memory>
+
+using namespace llvm;
+
+namespace {
+    // The registers of variables, numbers and temporaries are numbered from
+    // 0 each until the lowering knows how many numbers there are
+    enum RegKind : uint8_t { VarReg, ConstReg, TempReg };
+
+    struct Operand{
+        RegKind Kind;
+        uint32_t Index;
+    };
+
+    Bytecode::Opcode getOpcode(BinaryOp::Operator Op){
+        switch (Op){
+            case BinaryOp::Plus: return Bytecode::Add;
+            case BinaryOp::Minus: return Bytecode::Sub;
+            case BinaryOp::Mul: return Bytecode::Mul;
+            case BinaryOp::Div: return Bytecode::Div;
+        }
+        return Bytecode::Add;
+    }
+
+    // Emits the instructions in post-order, so the operands of an
+    // instruction are always computed before it
+    class Lowering : public ASTVisitor{
+        std::vector<uint32_t> VarIndex; // Indexed by identifier ID
+        DenseMap<int32_t, uint32_t> ConstIndex;
+        DenseMap<Expr *, uint32_t> TempIndex; // Shared nodes are computed once
+
+    public:
+        struct PendingInstr{
+            Bytecode::Opcode Op;
+            Operand L, R;
+        };
+        unsigned NumVars = 0;
+        std::vector<int32_t> Consts;
+        std::vector<PendingInstr> Code;
+        Operand Last{VarReg, 0}; // The register of the last visited node
+        std::vector<Operand> Results; // Empty for a bare expression, whose result is Last
+
+        virtual void visit(Factor &Node) override {
+            if (Node.getKind() == Factor::Ident){
+                Last = {VarReg, VarIndex[Node.getID()]};
+                return;
+            }
+            // Same conversion as in the code generator
+            int Val = 0;
+            Node.getVal().getAsInteger(10, Val);
+            auto Inserted = ConstIndex.try_emplace(Val, Consts.size());
+            if (Inserted.second)
+                Consts.push_back(Val);
+            Last = {ConstReg, Inserted.first->second};
+        }
+
+        virtual void visit(BinaryOp &Node) override {
+            auto Cached = TempIndex.find(&Node);
+            if (Cached != TempIndex.end()){
+                Last = {TempReg, Cached->second};
+                return;
+            }
+            Node.getLeft()->accept(*this);
+            Operand L = Last;
+            Node.getRight()->accept(*this);
+            Code.push_back({getOpcode(Node.getOperator()), L, Last});
+            Last = {TempReg, static_cast<uint32_t>(Code.size() - 1)};
+            TempIndex[&Node] = Last.Index;
+        }
+
+        virtual void visit(WithDecl &Node) override {
+            ArrayRef<unsigned> IDs = Node.getIDs();
+            for (unsigned I = 0, E = IDs.size(); I != E; ++I){
+                if (IDs[I] >= VarIndex.size())
+                    VarIndex.resize(IDs[I] + 1);
+                VarIndex[IDs[I]] = I;
+            }
+            NumVars = IDs.size();
+            for (Expr *E : Node.getExprs()){
+                E->accept(*this);
+                Results.push_back(Last);
+            }
+        }
+    };
+} // unnamed namespace
+
+Bytecode Bytecode::compile(AST *Tree){
+    Lowering Lower;
+    Tree->accept(Lower);
+
+    Bytecode Result;
+    Result.NumVars = Lower.NumVars;
+    uint32_t FirstConst = Lower.NumVars;
+    Result.FirstTemp = FirstConst + Lower.Consts.size();
+    auto place = [&](Operand Op) -> uint32_t {
+        switch (Op.Kind){
+            case VarReg: return Op.Index;
+            case ConstReg: return FirstConst + Op.Index;
+            case TempReg: return Result.FirstTemp + Op.Index;
+        }
+        return 0;
+    };
+    Result.Code.reserve(Lower.Code.size());
+    for (const Lowering::PendingInstr &I : Lower.Code)
+        Result.Code.push_back({I.Op, place(I.L), place(I.R)});
+    if (Lower.Results.empty())
+        Lower.Results.push_back(Lower.Last);
+    for (Operand Op : Lower.Results)
+        Result.Results.push_back(place(Op));
+    Result.Consts = std::move(Lower.Consts);
+    Result.NumRegs = Result.FirstTemp + Result.Code.size();
+    return Result;
+}
+
+bool Bytecode::eval(const int32_t *Vars, int32_t &Result) const {
+    assert(Results.size() == 1 && "Use eval(Vars, Results) for several results");
+    return eval(Vars, &Result);
+}
+
+bool Bytecode::eval(const int32_t *Vars, int32_t *Out) const {
+    // The registers of most expressions fit on the stack
+    int32_t Stack[256];
+    std::unique_ptr<int32_t[]> Heap;
+    int32_t *R = Stack;
+    if (NumRegs > std::size(Stack)){
+        Heap.reset(new int32_t[NumRegs]);
+        R = Heap.get();
+    }
+    if (NumVars)
+        std::memcpy(R, Vars, NumVars * sizeof(int32_t));
+    if (!Consts.empty())
+        std::memcpy(R + NumVars, Consts.data(), Consts.size() * sizeof(int32_t));
+    int32_t *Dst = R + FirstTemp;
+    for (const Instr &I : Code){
+        // Unsigned arithmetic wraps around where signed overflow would be undefined
+        uint32_t L = R[I.L], Rhs = R[I.R];
+        switch (I.Op){
+            case Add: *Dst++ = static_cast<int32_t>(L + Rhs); break;
+            case Sub: *Dst++ = static_cast<int32_t>(L - Rhs); break;
+            case Mul: *Dst++ = static_cast<int32_t>(L * Rhs); break;
+            case Div:
+                if (Rhs == 0 || (R[I.L] == INT_MIN && R[I.R] == -1))
+                    return false;
+                *Dst++ = R[I.L] / R[I.R];
+                break;
+        }
+    }
+    for (size_t K = 0, E = Results.size(); K != E; ++K)
+        Out[K] = R[Results[K]];
+    return true;
+}
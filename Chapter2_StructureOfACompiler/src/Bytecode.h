@@ -0,0 +1,53 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+#include "AST.h"
+#include <cstdint>
+#include <vector>
+
+// A checked expression lowered to register bytecode for the interpreter
+// tier. Lowering takes a single pass over the tree, so an expression can
+// be evaluated long before the JIT would have generated machine code; an
+// evaluation is slower than that of the machine code, though. Expressions
+// evaluated often are therefore promoted to the JIT (see calc::Engine).
+//
+// The registers hold the variables, followed by the numbers and the
+// results of the instructions, in this order. Instruction I computes
+// register FirstTemp + I from two registers, so the code needs no
+// separate destination operands and shared nodes of a simplified tree are
+// computed once, also when several results share them.
+class Bytecode{
+public:
+    enum Opcode : uint8_t { Add, Sub, Mul, Div };
+
+private:
+    struct Instr{
+        Opcode Op;
+        uint32_t L, R; // Operand registers
+    };
+    std::vector<Instr> Code;
+    std::vector<int32_t> Consts; // The values of the number registers
+    unsigned NumVars = 0;
+    uint32_t NumRegs = 0;
+    uint32_t FirstTemp = 0; // The register computed by the first instruction
+    std::vector<uint32_t> Results; // The registers holding the values of the results
+
+public:
+    // Tree must have passed Sema
+    static Bytecode compile(AST *Tree);
+
+    // Vars[I] is the value of the I-th declared variable, and Results[K]
+    // receives the value of the K-th result. Like the generated code (see
+    // CodeGen::compileResultsFunction()), +, - and * wrap around, and a
+    // division by zero or of INT_MIN by -1 returns false, leaving Results
+    // unchanged.
+    bool eval(const int32_t *Vars, int32_t *Results) const;
+
+    // For a tree with a single result
+    bool eval(const int32_t *Vars, int32_t &Result) const;
+
+    size_t size() const { return Code.size(); }
+    unsigned getNumResults() const { return Results.size(); }
+    unsigned getNumVars() const { return NumVars; }
+};
+
+#endif
@@ -1,9 +1,39 @@
+#include "Bytecode.h"
 #include "CodeGen.h"
+#include "CompileCache.h"
+#include "Daemon.h"
+#include "FileCompiler.h"
+#include "JIT.h"
+#include "LLVMCompat.h"
 #include "Parser.h"
+#include "RTCalc.h"
 #include "Sema.h"
+#include "ShapeRegistry.h"
+#include "Simplify.h"
+#include "StreamCompiler.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/CodeGen/CommandFlags.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/PassTimingInfo.h"
+#include "llvm/MC/TargetRegistry.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include <chrono>
+#include <cstdio>
+#include <optional>
+#include <random>
+#include <thread>
+#include <vector>
 
 /* LLVM has its own system for parsing command line arguments.
  * Each component can add its own command line options which are
@@ -11,31 +41,776 @@
  * The command line options are declared as static variables.
  */
 
+ // Registers the options of llc which select the target, e.g. -mcpu, -mattr
+ // and -filetype
+ static llvm::codegen::RegisterCodeGenFlags CGF;
+
  static llvm::cl::opt<std::string> Input(llvm::cl::Positional, llvm::cl::desc("<input expression>"), llvm::cl::init(""));
 
- int main(int argc, const char **argv){
-    llvm::InitLLVM X(argc, argv);
-    llvm::cl::ParseCommandLineOptions(argc, argv, "calc - the expression compiler \n");
+ static llvm::cl::opt<std::string> OutputFilename("o", llvm::cl::desc("Output file, machine code if it ends in .o or with -filetype (default = stdout)"),
+                                                  llvm::cl::value_desc("filename"), llvm::cl::init("-"));
+
+ static llvm::cl::opt<std::string> MTriple("mtriple", llvm::cl::desc("Override the target triple of the host"));
+
+ static llvm::cl::opt<std::string> InputFile("f", llvm::cl::desc("Compile a file with one expression per line into functions calc_expr_<line>, "
+                                                                "or evaluate the lines with --run"),
+                                             llvm::cl::value_desc("filename"));
+
+ static llvm::cl::opt<bool> HoistConstants("hoist-constants", llvm::cl::desc("With --run -f, compile one function per expression shape and pass "
+                                                                           "the numbers as parameters"),
+                                           llvm::cl::init(true));
+
+ static llvm::cl::opt<Parser::Strategy> ParserStrategy("parser", llvm::cl::desc("How expressions are parsed"),
+                                                       llvm::cl::values(clEnumValN(Parser::RecursiveDescent, "recursive", "Recursive descent (default)"),
+                                                                        clEnumValN(Parser::OperatorPrecedence, "climb", "Iterative precedence climbing, for deeply nested expressions")),
+                                                       llvm::cl::init(Parser::RecursiveDescent));
+
+ static llvm::cl::opt<bool> Stream("stream", llvm::cl::desc("Generate the IR of main() while parsing, without building an AST, "
+                                                            "for the lowest compile time of small expressions"));
+
+ static llvm::cl::opt<bool> Run("run", llvm::cl::desc("Execute the expression in-process with the ORC JIT instead of printing IR"));
+
+ static llvm::cl::opt<bool> Kernel("kernel", llvm::cl::desc("Generate calc_kernel(), which evaluates the expression for a batch of rows, instead of main()"));
+
+ static llvm::cl::opt<unsigned> KernelWidth("kernel-width", llvm::cl::desc("Number of rows calc_kernel() evaluates with one vector operation"), llvm::cl::init(8));
+
+ static llvm::cl::opt<unsigned> Rows("rows", llvm::cl::desc("Number of random rows evaluated by --run --kernel"), llvm::cl::init(1 << 22));
+
+ static llvm::cl::opt<unsigned> Threads("threads", llvm::cl::desc("Number of threads compiling the lines of -f, and the maximum number of threads "
+                                                                 "measured by --run --kernel (0 = one per CPU)"),
+                                        llvm::cl::init(1));
+
+ static llvm::cl::opt<std::string> InputValues("input", llvm::cl::desc("With --run, read the variables from this file instead of prompting, "
+                                                                   "and evaluate the expression for every row"),
+                                               llvm::cl::value_desc("filename"));
+
+ static llvm::cl::opt<calc_input_format> InputFormat("input-format", llvm::cl::desc("Format of -input"),
+                                                     llvm::cl::values(clEnumValN(CALC_INPUT_CSV, "csv", "Decimal numbers separated by commas or white space"),
+                                                                      clEnumValN(CALC_INPUT_BINARY, "bin", "Native-endian int32 values")),
+                                                     llvm::cl::init(CALC_INPUT_CSV));
+
+ static llvm::cl::opt<unsigned> OptLevel("O", llvm::cl::desc("Optimization level: -O0, -O1, -O2 or -O3 (default = -O0)"),
+                                         llvm::cl::Prefix, llvm::cl::init(0));
+
+ static llvm::cl::opt<bool> ASTStats("ast-stats", llvm::cl::desc("Print the number of AST nodes, the memory of the AST arena and the simplifications"));
 
-    Lexer Lex(Input);
-    // Parsing and Syntactic analysis
-    Parser Parser(Lex);
-    AST *Tree = Parser.parse();
-    if (!Tree || Parser.hasError())
+ static llvm::cl::opt<bool> Fold("fold", llvm::cl::desc("Fold constant operations and share identical subexpressions before code generation"),
+                                 llvm::cl::init(true));
+
+ static llvm::cl::list<std::string> Defines("D", llvm::cl::desc("Bind a variable to a constant, e.g. -Dscale=3. The variable is no longer read "
+                                                                "at run time, and the operations on it are folded"),
+                                            llvm::cl::value_desc("name=value"), llvm::cl::Prefix);
+
+ static llvm::cl::opt<std::string> CacheDir("cache-dir", llvm::cl::desc("Reuse compiled expressions stored in this directory, and store new ones"),
+                                            llvm::cl::value_desc("directory"));
+
+ static llvm::cl::opt<std::string> CachePolicy("cache-policy", llvm::cl::desc("Pruning policy of -cache-dir, e.g. cache_size_bytes=64m"),
+                                               llvm::cl::init("cache_size_bytes=64m"));
+
+ static llvm::cl::opt<unsigned> JITThreshold("jit-threshold", llvm::cl::desc("With --run and --daemon, interpret an expression until it is "
+                                                                          "evaluated this often, then compile it (0 = compile at once)"),
+                                             llvm::cl::init(calc::Engine::DefaultJITThreshold));
+
+ static llvm::cl::opt<bool> Daemon("daemon", llvm::cl::desc("Keep running and serve the expressions of calc --client on -socket"));
+
+ static llvm::cl::opt<bool> Client("client", llvm::cl::desc("Let a calc --daemon evaluate the expression for the rows of -input or stdin, "
+                                                           "or compile it into the object file -o"));
+
+ static llvm::cl::opt<std::string> SocketPath("socket", llvm::cl::desc("Socket of --daemon and --client (default = calc.sock in "
+                                                                      "$XDG_RUNTIME_DIR or in a private directory)"),
+                                              llvm::cl::value_desc("path"));
+
+ static llvm::cl::opt<bool> CacheStats("cache-stats", llvm::cl::desc("Print the hits and misses of -cache-dir"));
+
+ static llvm::ExitOnError ExitOnErr("calc: ");
+
+ // The variables bound with -D, in command line order
+ static std::vector<std::pair<std::string, int32_t>> Bindings;
+
+ static bool parseDefines(){
+    for (llvm::StringRef Define : Defines){
+        std::pair<llvm::StringRef, llvm::StringRef> NameValue = Define.split('=');
+        int32_t Value;
+        if (NameValue.first.empty() || !llvm::all_of(NameValue.first, llvm::isAlpha) ||
+            NameValue.second.getAsInteger(10, Value)){
+            llvm::errs() << "calc: invalid -D" << Define << ", expected -Dname=value\n";
+            return false;
+        }
+        Bindings.emplace_back(NameValue.first.str(), Value);
+    }
+    return true;
+ }
+
+ // Returns a simplifier with the -D bindings, if the tree is to be simplified at all
+ static std::optional<Simplifier> createSimplifier(ASTContext &ASTCtx){
+    if (!Fold && Bindings.empty())
+        return std::nullopt;
+    std::optional<Simplifier> Simplify(std::in_place, ASTCtx, Fold);
+    for (const auto &B : Bindings)
+        Simplify->bind(B.first, B.second);
+    return Simplify;
+ }
+
+ // With -time-passes, the phases of calc are reported next to the passes
+ static llvm::NamedRegionTimer phaseTimer(llvm::StringRef Name, llvm::StringRef Description){
+    return llvm::NamedRegionTimer(Name, Description, "calc", "calc phases", llvm::TimePassesIsEnabled);
+ }
+
+ using Clock = std::chrono::steady_clock;
+
+ static double millisecondsSince(Clock::time_point Start){
+    return std::chrono::duration<double, std::milli>(Clock::now() - Start).count();
+ }
+
+ // Hands the module to the JIT and calls the generated main() directly.
+ static int runModule(std::unique_ptr<llvm::Module> M, std::unique_ptr<llvm::LLVMContext> Ctx,
+                      Clock::time_point Start){
+    // In batch mode, main() consumes one row of the input per call, so a
+    // main() which reads no variable would never reach its end. The module
+    // may come from the cache or the StreamCompiler, so it is checked
+    // rather than the tree.
+    if (!InputValues.empty() && !M->getFunction("calc_read")){
+        llvm::errs() << "calc: -input requires an expression with variables\n";
+        return 1;
+    }
+    std::unique_ptr<CalcJIT> JIT = ExitOnErr(CalcJIT::create());
+    ExitOnErr(JIT->addModule(std::move(M), std::move(Ctx)));
+    // Looking up main() triggers the actual machine code generation
+    int (*Main)(int, char **);
     {
-        llvm::errs() << "Syntax errors occured\n";
+        auto Timer = phaseTimer("jit", "JIT code generation");
+        Main = ExitOnErr(JIT->lookupFunction<int(int, char **)>("main"));
+    }
+    double CompileTime = millisecondsSince(Start);
+
+    Clock::time_point ExecStart = Clock::now();
+    int Result = 0;
+    if (InputValues.empty()){
+        Result = Main(0, nullptr);
+        std::fflush(stdout); // The runtime writes with printf()
+    } else {
+        // In batch mode, main() consumes one row of the input per call
+        if (calc_open_input(InputValues.c_str(), InputFormat)){
+            llvm::errs() << "calc: cannot read " << InputValues << "\n";
+            return 1;
+        }
+        while (!Result && !calc_input_done())
+            Result = Main(0, nullptr);
+        calc_flush();
+    }
+    double ExecTime = millisecondsSince(ExecStart);
+
+    // Timings go to stderr to keep them apart from the program output
+    llvm::errs() << llvm::format("Compiled in %.3f ms, executed in %.3f ms, total %.3f ms\n",
+                                 CompileTime, ExecTime, millisecondsSince(Start));
+    return Result;
+ }
+
+ using KernelFn = size_t(const int32_t *const *, int32_t *, size_t);
+
+ // Measures the throughput of calc_run_parallel() for 1 up to MaxThreads
+ // threads and checks the results against the single-threaded Expected.
+ static bool runScaling(KernelFn *Fn, llvm::ArrayRef<const int32_t *> ColPtrs,
+                        const std::vector<int32_t> &Expected, unsigned MaxThreads){
+    std::vector<int32_t> Out(Rows);
+    double Base = 0;
+    for (unsigned T = 1; T <= MaxThreads; ++T){
+        double Best = 0;
+        for (int I = 0; I < 5; ++I){
+            Clock::time_point Start = Clock::now();
+            size_t BadRow;
+            if (calc_run_parallel(Fn, ColPtrs.data(), ColPtrs.size(), Out.data(), Rows, T, &BadRow)){
+                llvm::errs() << "calc: calc_run_parallel() failed\n";
+                return false;
+            }
+            double Ms = millisecondsSince(Start);
+            Best = I == 0 ? Ms : std::min(Best, Ms);
+        }
+        if (Out != Expected){
+            llvm::errs() << "calc: parallel evaluation with " << T << " threads disagrees\n";
+            return false;
+        }
+        double Rate = Rows / (Best / 1000.0);
+        if (T == 1)
+            Base = Rate;
+        llvm::outs() << llvm::format("  %2u threads: %10.2f Mrows/s, %5.2fx\n", T, Rate / 1e6, Rate / Base);
+    }
+    return true;
+ }
+
+ // Evaluates random rows once with the vector kernel and once with a scalar
+ // kernel (width 1) and reports the throughput of both.
+ static int runKernel(AST *Tree, llvm::TargetMachine &TM){
+    std::unique_ptr<CalcJIT> JIT = ExitOnErr(CalcJIT::create());
+    llvm::SmallVector<unsigned, 2> Widths = {KernelWidth};
+    if (KernelWidth != 1 && InputValues.empty())
+        Widths.push_back(1);
+    for (unsigned Width : Widths){
+        auto Ctx = std::make_unique<llvm::LLVMContext>();
+        std::string Name = Width == 1 ? "calc_kernel_scalar" : "calc_kernel";
+        CodeGen CodeGenerator(&TM);
+        std::unique_ptr<llvm::Module> M = CodeGenerator.compileKernel(Tree, *Ctx, Width, Name);
+        CodeGenerator.optimize(*M, OptLevel);
+        ExitOnErr(JIT->addModule(std::move(M), std::move(Ctx)));
+    }
+    KernelFn *VectorFn = ExitOnErr(JIT->lookupFunction<KernelFn>(KernelWidth == 1 ? "calc_kernel_scalar" : "calc_kernel"));
+    DeclCollector Decls;
+    Tree->accept(Decls);
+
+    if (!InputValues.empty()){
+        if (Decls.Vars.empty()){
+            llvm::errs() << "calc: -input requires an expression with variables\n";
+            return 1;
+        }
+        Clock::time_point Start = Clock::now();
+        size_t BadRow;
+        long N = calc_eval_file(VectorFn, Decls.Vars.size(), InputValues.c_str(), InputFormat, Threads, &BadRow);
+        if (N == -2){
+            llvm::errs() << "calc: division by zero or of INT_MIN by -1 in row " << BadRow + 1 << "\n";
+            return 1;
+        }
+        if (N < 0){
+            llvm::errs() << "calc: cannot evaluate " << InputValues << "\n";
+            return 1;
+        }
+        double Ms = millisecondsSince(Start);
+        llvm::errs() << llvm::format("Evaluated %ld rows in %.3f ms, %.2f Mrows/s\n", N, Ms, N / (Ms * 1000.0));
+        return 0;
+    }
+    KernelFn *ScalarFn = ExitOnErr(JIT->lookupFunction<KernelFn>("calc_kernel_scalar"));
+
+    // Values start at 1, so that plain variables are never divisors of 0
+    std::mt19937 Gen(42);
+    std::uniform_int_distribution<int32_t> Dist(1, 1000);
+    std::vector<std::vector<int32_t>> Columns(Decls.Vars.size(), std::vector<int32_t>(Rows));
+    std::vector<const int32_t *> ColPtrs;
+    for (auto &Col : Columns){
+        for (int32_t &Val : Col)
+            Val = Dist(Gen);
+        ColPtrs.push_back(Col.data());
+    }
+
+    // Best of several runs, to factor out page faults on the first touch of Out
+    size_t Done = Rows;
+    auto Measure = [&](KernelFn *Fn, std::vector<int32_t> &Out){
+        double Best = 0;
+        for (int I = 0; I < 5; ++I){
+            Clock::time_point Start = Clock::now();
+            Done = Fn(ColPtrs.data(), Out.data(), Rows);
+            double Ms = millisecondsSince(Start);
+            Best = I == 0 ? Ms : std::min(Best, Ms);
+        }
+        return Rows / (Best / 1000.0);
+    };
+    std::vector<int32_t> VectorOut(Rows), ScalarOut(Rows);
+    double VectorRate = Measure(VectorFn, VectorOut);
+    if (Done != Rows){
+        llvm::errs() << "calc: division by zero or of INT_MIN by -1 in row " << Done + 1 << "\n";
+        return 1;
+    }
+    double ScalarRate = Measure(ScalarFn, ScalarOut);
+    if (Done != Rows || VectorOut != ScalarOut){
+        llvm::errs() << "calc: vector and scalar kernel disagree\n";
         return 1;
     }
 
-    // Semantic anlaysis
-    Sema Semantic;
-    if(Semantic.semantic(Tree)){
+    llvm::outs() << llvm::format("Evaluated %u rows of %zu variables\n", (unsigned)Rows, Decls.Vars.size());
+    llvm::outs() << llvm::format("  width %2u: %10.2f Mrows/s\n", (unsigned)KernelWidth, VectorRate / 1e6);
+    llvm::outs() << llvm::format("  width  1: %10.2f Mrows/s\n", ScalarRate / 1e6);
+    llvm::outs() << llvm::format("  speedup:  %10.2fx\n", VectorRate / ScalarRate);
+
+    unsigned MaxThreads = Threads ? Threads : std::max(1u, std::thread::hardware_concurrency());
+    if (MaxThreads > 1){
+        llvm::outs() << "Scaling of width " << KernelWidth << " with calc_run_parallel():\n";
+        if (!runScaling(VectorFn, ColPtrs, VectorOut, MaxThreads))
+            return 1;
+    }
+    return 0;
+ }
+
+ // Creates the target machine selected with -mtriple, -mcpu and -mattr.
+ // -mcpu=native selects the CPU of the host together with all its features.
+ static std::unique_ptr<llvm::TargetMachine> createTargetMachine(){
+    llvm::Triple Triple(MTriple.empty() ? llvm::sys::getDefaultTargetTriple() : llvm::Triple::normalize(MTriple));
+    std::string Error;
+    const llvm::Target *Target = llvm::TargetRegistry::lookupTarget(llvm::codegen::getMArch(), Triple, Error);
+    if (!Target){
+        llvm::errs() << "calc: " << Error << "\n";
+        return nullptr;
+    }
+    llvm::TargetOptions Options = llvm::codegen::InitTargetOptionsFromCodeGenFlags(Triple);
+    // Linkers default to position independent executables nowadays
+    auto RelocModel = llvm::codegen::getExplicitRelocModel();
+    if (!RelocModel)
+        RelocModel = llvm::Reloc::PIC_;
+    llvm::CodeGenOpt::Level Levels[] = {llvm::CodeGenOpt::None, llvm::CodeGenOpt::Less,
+                                        llvm::CodeGenOpt::Default, llvm::CodeGenOpt::Aggressive};
+    return std::unique_ptr<llvm::TargetMachine>(Target->createTargetMachine(
+        Triple.getTriple(), llvm::codegen::getCPUStr(), llvm::codegen::getFeaturesStr(), Options,
+        RelocModel, llvm::codegen::getExplicitCodeModel(), Levels[OptLevel]));
+ }
+
+ // Writes M to -o. Machine code is emitted for -filetype or an output file
+ // ending in .o, otherwise the IR is printed.
+ static bool emit(llvm::Module &M, llvm::TargetMachine &TM){
+    auto FileType = llvm::codegen::getExplicitFileType();
+    if (!FileType && llvm::StringRef(OutputFilename).endswith(".o"))
+        FileType = llvm::CGFT_ObjectFile;
+
+    std::error_code EC;
+    llvm::sys::fs::OpenFlags Flags = !FileType || *FileType == llvm::CGFT_AssemblyFile ? llvm::sys::fs::OF_Text
+                                                                                        : llvm::sys::fs::OF_None;
+    llvm::ToolOutputFile Out(OutputFilename, EC, Flags);
+    if (EC){
+        llvm::errs() << "calc: cannot open " << OutputFilename << ": " << EC.message() << "\n";
+        return false;
+    }
+    if (!FileType){
+        auto Timer = phaseTimer("print", "IR printing");
+        M.print(Out.os(), nullptr); // Dump generated IR
+    } else {
+        auto Timer = phaseTimer("emit", "Machine code emission");
+        llvm::legacy::PassManager PM;
+        if (TM.addPassesToEmitFile(PM, Out.os(), nullptr, *FileType)){
+            llvm::errs() << "calc: the target cannot emit this file type\n";
+            return false;
+        }
+        PM.run(M);
+    }
+    Out.keep();
+    return true;
+ }
+
+ // Describes the options the generated module depends on, as part of the
+ // key of the compile cache. Options added to the code generation must be
+ // added here, too.
+ static std::string getCodeGenOptions(const llvm::TargetMachine &TM){
+    std::string Options;
+    llvm::raw_string_ostream OS(Options);
+    OS << TM.getTargetTriple().str() << " " << TM.getTargetCPU() << " " << TM.getTargetFeatureString();
+    OS << " O" << OptLevel << (Fold ? " fold" : "");
+    for (const auto &B : Bindings)
+        OS << " -D" << B.first << "=" << B.second;
+    if (Kernel)
+        OS << " kernel" << KernelWidth;
+    if (Stream)
+        OS << " stream";
+    return OS.str();
+ }
+
+ // Parses, checks and simplifies Input. Returns nullptr after reporting an error.
+ static AST *parseInput(ASTContext &ASTCtx){
+    AST *Tree;
+    {
+        auto Timer = phaseTimer("parse", "Parsing");
+        Lexer Lex(Input);
+        // Parsing and Syntactic analysis
+        Parser Parser(Lex, ASTCtx);
+        Parser.setStrategy(ParserStrategy);
+        Tree = Parser.parse();
+        if (!Tree || Parser.hasError())
+        {
+            llvm::errs() << "Syntax errors occured\n";
+            return nullptr;
+        }
+    }
+    if (ASTStats)
+        ASTCtx.printStats(llvm::errs());
+
+    {
+        auto Timer = phaseTimer("sema", "Semantic analysis");
+        // Semantic anlaysis
+        Sema Semantic;
+        if(Semantic.semantic(Tree)){
+            llvm::errs() << "Sematinc errors occurred \n";
+            return nullptr;
+        }
+    }
+
+    // Unlike the lines of a file, a single expression must declare every
+    // bound variable, which catches misspelled names
+    DeclCollector Decls;
+    Tree->accept(Decls);
+    if (Kernel && Decls.Exprs.size() != 1){
+        llvm::errs() << "calc: -kernel needs an expression with a single result\n";
+        return nullptr;
+    }
+    for (const auto &B : Bindings){
+        if (!llvm::is_contained(Decls.Vars, B.first)){
+            llvm::errs() << "calc: -D" << B.first << ": the expression does not declare " << B.first << "\n";
+            return nullptr;
+        }
+    }
+
+    if (std::optional<Simplifier> Simplify = createSimplifier(ASTCtx)){
+        auto Timer = phaseTimer("simplify", "Simplification");
+        Tree = Simplify->simplify(Tree);
+        if (ASTStats)
+            Simplify->printStats(llvm::errs());
+    }
+    return Tree;
+ }
+
+ // Compiles Input in one pass with the StreamCompiler. Returns nullptr
+ // after reporting an error, with the same messages as parseInput().
+ static std::unique_ptr<llvm::Module> streamInput(llvm::LLVMContext &Ctx, llvm::TargetMachine &TM){
+    auto Timer = phaseTimer("stream", "Parsing and IR generation");
+    StreamCompiler Compiler(&TM);
+    for (const auto &B : Bindings)
+        Compiler.bind(B.first, B.second);
+    std::unique_ptr<llvm::Module> M = Compiler.compile(Input, Ctx);
+    if (Compiler.hasSyntaxError()){
+        llvm::errs() << "Syntax errors occured\n";
+        return nullptr;
+    }
+    if (Compiler.hasSemanticError()){
         llvm::errs() << "Sematinc errors occurred \n";
+        return nullptr;
+    }
+    for (const auto &B : Bindings){
+        if (!Compiler.declares(B.first)){
+            llvm::errs() << "calc: -D" << B.first << ": the expression does not declare " << B.first << "\n";
+            return nullptr;
+        }
+    }
+    return M;
+ }
+
+ // Compiles the lines of InputFile in parallel and prints the linked module.
+ static int compileFile(llvm::TargetMachine &TM){
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buffer = llvm::MemoryBuffer::getFileOrSTDIN(InputFile);
+    if (!Buffer){
+        llvm::errs() << "calc: cannot read " << InputFile << ": " << Buffer.getError().message() << "\n";
+        return 1;
+    }
+    llvm::LLVMContext Ctx;
+    std::unique_ptr<llvm::Module> M;
+    {
+        auto Timer = phaseTimer("compile", "Compiling the lines");
+        FileCompiler Compiler(createTargetMachine, Threads, OptLevel, Fold);
+        for (const auto &B : Bindings)
+            Compiler.bind(B.first, B.second);
+        M = Compiler.compile(**Buffer, Ctx, llvm::errs());
+    }
+    if (!M)
+        return 1;
+    return emit(*M, TM) ? 0 : 1;
+ }
+
+ // Evaluates the lines of InputFile one after the other, reading the
+ // variables with calc_read() like the generated main(). The lines are
+ // compiled through a ShapeRegistry, so lines which differ only in their
+ // numbers share one compiled function. With -input, the lines are
+ // evaluated again until the input is consumed.
+ static int runFile(llvm::TargetMachine &TM, Clock::time_point Start){
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buffer = llvm::MemoryBuffer::getFileOrSTDIN(InputFile);
+    if (!Buffer){
+        llvm::errs() << "calc: cannot read " << InputFile << ": " << Buffer.getError().message() << "\n";
+        return 1;
+    }
+    std::unique_ptr<CalcJIT> JIT = ExitOnErr(CalcJIT::create());
+    ShapeRegistry Registry(*JIT, &TM, OptLevel, HoistConstants);
+
+    struct Line{
+        ShapeRegistry::Instance Expr;
+        std::vector<std::string> Vars; // Null-terminated for calc_read()
+        unsigned Number; // Of the line in InputFile
+    };
+    std::vector<Line> Lines;
+    for (llvm::line_iterator I(**Buffer, /*SkipBlanks=*/true, '#'), E; I != E; ++I){
+        std::string Diags;
+        llvm::raw_string_ostream OS(Diags);
+        ASTContext ASTCtx;
+        Lexer Lex(*I);
+        Parser Parser(Lex, ASTCtx, OS);
+        Parser.setStrategy(ParserStrategy);
+        AST *Tree = Parser.parse();
+        bool Ok = Tree && !Parser.hasError() && !Sema(OS).semantic(Tree);
+        DeclCollector Decls;
+        if (Ok){
+            // Every line is one shape with one result
+            Tree->accept(Decls);
+            Ok = Decls.Exprs.size() == 1;
+            if (!Ok)
+                OS << "Several results are only supported for a single expression\n";
+        }
+        if (Ok){
+            if (std::optional<Simplifier> Simplify = createSimplifier(ASTCtx))
+                Tree = Simplify->simplify(Tree);
+            // The variables bound with -D are gone from the simplified tree
+            DeclCollector Remaining;
+            Tree->accept(Remaining);
+            Lines.push_back({ExitOnErr(Registry.get(Tree)), {Remaining.Vars.begin(), Remaining.Vars.end()},
+                             static_cast<unsigned>(I.line_number())});
+            continue;
+        }
+        llvm::SmallVector<llvm::StringRef, 4> Messages;
+        llvm::StringRef(OS.str()).split(Messages, '\n', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+        for (llvm::StringRef Msg : Messages)
+            llvm::errs() << (*Buffer)->getBufferIdentifier() << ":" << I.line_number() << ": " << Msg << "\n";
         return 1;
     }
+    double CompileTime = millisecondsSince(Start);
 
-    // Code generation
-    CodeGen CodeGenerator;
-    CodeGenerator.compile(Tree);
+    // A pass over the lines must read a value, or the input is never consumed
+    if (!InputValues.empty() && llvm::all_of(Lines, [](const Line &L){ return L.Vars.empty(); })){
+        llvm::errs() << "calc: -input requires a line with variables\n";
+        return 1;
+    }
+    Clock::time_point ExecStart = Clock::now();
+    if (!InputValues.empty() && calc_open_input(InputValues.c_str(), InputFormat)){
+        llvm::errs() << "calc: cannot read " << InputValues << "\n";
+        return 1;
+    }
+    std::vector<int32_t> Values;
+    do {
+        for (Line &L : Lines){
+            Values.clear();
+            for (std::string &Var : L.Vars)
+                Values.push_back(calc_read(Var.data()));
+            int32_t Result;
+            if (!L.Expr.eval(Values.data(), Result)){
+                calc_flush();
+                llvm::errs() << (*Buffer)->getBufferIdentifier() << ":" << L.Number
+                             << ": division by zero or of INT_MIN by -1\n";
+                return 1;
+            }
+            calc_write(Result);
+        }
+    } while (!InputValues.empty() && !calc_input_done());
+    calc_flush();
+    double ExecTime = millisecondsSince(ExecStart);
+
+    Registry.printStats(llvm::errs());
+    llvm::errs() << llvm::format("Compiled in %.3f ms, executed in %.3f ms, total %.3f ms\n",
+                                 CompileTime, ExecTime, millisecondsSince(Start));
+    return 0;
+ }
+
+ // Evaluates the expression like the main() of runModule(), but with the
+ // interpreter. The evaluation which reaches -jit-threshold generates code
+ // for the expression, which evaluates the remaining rows of -input.
+ static int runTiered(AST *Tree, llvm::TargetMachine &TM, Clock::time_point Start){
+    Bytecode Code;
+    {
+        auto Timer = phaseTimer("bytecode", "Bytecode lowering");
+        Code = Bytecode::compile(Tree);
+    }
+    DeclCollector Decls;
+    Tree->accept(Decls);
+    std::vector<std::string> Names(Decls.Vars.begin(), Decls.Vars.end());
+    double CompileTime = millisecondsSince(Start);
+
+    // Like for main(), each evaluation consumes one row of the input, which
+    // it cannot do without variables
+    if (!InputValues.empty() && Names.empty()){
+        llvm::errs() << "calc: -input requires an expression with variables\n";
+        return 1;
+    }
+    if (!InputValues.empty() && calc_open_input(InputValues.c_str(), InputFormat)){
+        llvm::errs() << "calc: cannot read " << InputValues << "\n";
+        return 1;
+    }
+    using FnTy = bool(const int32_t *, int32_t *);
+    FnTy *Fn = nullptr;
+    std::unique_ptr<CalcJIT> JIT;
+    std::vector<int32_t> Vars(Names.size()), Results(Code.getNumResults());
+    unsigned long Interpreted = 0;
+    double JITTime = 0;
+    Clock::time_point ExecStart = Clock::now();
+    do {
+        for (size_t I = 0; I < Names.size(); ++I)
+            Vars[I] = calc_read(&Names[I][0]);
+        if (!Fn && Interpreted + 1 == JITThreshold){
+            auto Timer = phaseTimer("jit", "JIT code generation");
+            Clock::time_point JITStart = Clock::now();
+            auto Ctx = std::make_unique<llvm::LLVMContext>();
+            auto M = std::make_unique<llvm::Module>("calc.expr", *Ctx);
+            M->setDataLayout(TM.createDataLayout());
+            M->setTargetTriple(TM.getTargetTriple().getTriple());
+            CodeGen CodeGenerator(&TM);
+            CodeGenerator.compileResultsFunction(Tree, *M, "calc_fn");
+            CodeGenerator.optimize(*M, OptLevel);
+            JIT = ExitOnErr(CalcJIT::create());
+            ExitOnErr(JIT->addModule(std::move(M), std::move(Ctx)));
+            Fn = ExitOnErr(JIT->lookupFunction<FnTy>("calc_fn"));
+            JITTime = millisecondsSince(JITStart);
+        }
+        bool Ok = Fn ? Fn(Vars.data(), Results.data()) : Code.eval(Vars.data(), Results.data());
+        if (!Fn)
+            ++Interpreted;
+        if (!Ok){
+            calc_flush();
+            llvm::errs() << "calc: division by zero or of INT_MIN by -1\n";
+            return 1;
+        }
+        for (int32_t Result : Results)
+            calc_write(Result);
+    } while (!InputValues.empty() && !calc_input_done());
+    if (InputValues.empty())
+        std::fflush(stdout); // The runtime writes with printf()
+    else
+        calc_flush();
+    double ExecTime = millisecondsSince(ExecStart);
+
+    llvm::errs() << llvm::format("Compiled in %.3f ms, executed in %.3f ms, total %.3f ms\n",
+                                 CompileTime, ExecTime, millisecondsSince(Start));
+    if (Fn)
+        llvm::errs() << llvm::format("Interpreted %lu evaluations, then generated code in %.3f ms\n", Interpreted, JITTime);
+    return 0;
+ }
+
+ // Serves calc --client until the process is killed
+ static int runDaemon(llvm::TargetMachine &TM){
+    std::unique_ptr<calcd::Server> Server = ExitOnErr(calcd::Server::create(TM, OptLevel, JITThreshold));
+    std::string Path = SocketPath.empty() ? ExitOnErr(calcd::getDefaultSocketPath()) : SocketPath;
+    llvm::errs() << "calc: serving on " << Path << "\n";
+    ExitOnErr(Server->serve(Path));
     return 0;
- }
\ No newline at end of file
+ }
+
+ // Sends Input to the daemon. For an object file, like with -o expr.o, the
+ // daemon compiles main(). Otherwise it evaluates the expression for every
+ // row of -input or of stdin, and the results are written like in batch
+ // mode, one per line.
+ static int runClient(){
+    std::unique_ptr<calcd::Client> Client =
+        ExitOnErr(calcd::Client::connect(SocketPath.empty() ? ExitOnErr(calcd::getDefaultSocketPath()) : SocketPath));
+    auto FileType = llvm::codegen::getExplicitFileType();
+    bool Object = FileType ? *FileType == llvm::CGFT_ObjectFile : llvm::StringRef(OutputFilename).endswith(".o");
+
+    std::error_code EC;
+    llvm::ToolOutputFile Out(OutputFilename, EC, Object ? llvm::sys::fs::OF_None : llvm::sys::fs::OF_Text);
+    if (EC){
+        llvm::errs() << "calc: cannot open " << OutputFilename << ": " << EC.message() << "\n";
+        return 1;
+    }
+    if (Object){
+        Out.os() << ExitOnErr(Client->emitObject(Input));
+    } else {
+        // An expression without variables needs no values, so a terminal is not waited for
+        std::unique_ptr<llvm::MemoryBuffer> Values;
+        if (!InputValues.empty() || !llvm::sys::Process::StandardInIsUserInput()){
+            llvm::StringRef Name = InputValues.empty() ? "-" : llvm::StringRef(InputValues);
+            llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buffer = llvm::MemoryBuffer::getFileOrSTDIN(Name);
+            if (!Buffer){
+                llvm::errs() << "calc: cannot read " << Name << ": " << Buffer.getError().message() << "\n";
+                return 1;
+            }
+            Values = std::move(*Buffer);
+        }
+        std::vector<int32_t> Results =
+            ExitOnErr(Client->evaluate(Input, Values ? Values->getBuffer() : "", InputFormat));
+        for (int32_t Result : Results)
+            Out.os() << Result << "\n";
+    }
+    Out.keep();
+    return 0;
+ }
+
+ int main(int argc, const char **argv){
+    llvm::InitLLVM X(argc, argv);
+    llvm::cl::ParseCommandLineOptions(argc, argv, "calc - the expression compiler \n");
+    compat::enableOpaquePointers();
+
+    if (!llvm::isPowerOf2_32(KernelWidth)){
+        llvm::errs() << "calc: -kernel-width must be a power of two\n";
+        return 1;
+    }
+    if (OptLevel > 3){
+        llvm::errs() << "calc: invalid optimization level -O" << OptLevel << "\n";
+        return 1;
+    }
+    if (!parseDefines())
+        return 1;
+
+    // The client needs no target, so it starts as fast as possible
+    if (Client){
+        if (Input.empty() || Daemon || Run || Kernel || Stream || !InputFile.empty() || !Bindings.empty()){
+            llvm::errs() << "calc: --client needs an input expression and cannot be combined with --daemon, "
+                            "--run, -kernel, -stream, -f or -D\n";
+            return 1;
+        }
+        return runClient();
+    }
+
+    // Code is generated for the machine calc is running on, unless -mtriple
+    // selects another target
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    std::unique_ptr<llvm::TargetMachine> TM = createTargetMachine();
+    if (!TM)
+        return 1;
+
+    if (Daemon)
+        return runDaemon(*TM);
+
+    if (Stream && Kernel){
+        llvm::errs() << "calc: -stream cannot be combined with -kernel\n";
+        return 1;
+    }
+
+    Clock::time_point Start = Clock::now();
+    if (!InputFile.empty()){
+        if (!Input.empty() || Kernel){
+            llvm::errs() << "calc: -f cannot be combined with an input expression or -kernel\n";
+            return 1;
+        }
+        return Run ? runFile(*TM, Start) : compileFile(*TM);
+    }
+
+    // Owns the AST, which is released at once when main() returns
+    ASTContext ASTCtx;
+    if (Kernel && Run){
+        AST *Tree = parseInput(ASTCtx);
+        return Tree ? runKernel(Tree, *TM) : 1;
+    }
+    // The cache and -stream produce a module for main(), which is run as is
+    if (Run && JITThreshold && !Stream && CacheDir.empty()){
+        AST *Tree = parseInput(ASTCtx);
+        return Tree ? runTiered(Tree, *TM, Start) : 1;
+    }
+
+    auto Ctx = std::make_unique<llvm::LLVMContext>();
+    std::unique_ptr<llvm::Module> M;
+    std::unique_ptr<CompileCache> Cache;
+    std::string CacheKey;
+    if (!CacheDir.empty()){
+        auto Timer = phaseTimer("cache", "Cache lookup");
+        Cache = ExitOnErr(CompileCache::create(CacheDir, CachePolicy));
+        CacheKey = CompileCache::computeKey(Input, getCodeGenOptions(*TM));
+        M = Cache->lookup(CacheKey, *Ctx);
+    }
+
+    if (!M){
+        CodeGen CodeGenerator(TM.get());
+        if (Stream){
+            M = streamInput(*Ctx, *TM);
+            if (!M)
+                return 1;
+        } else {
+            AST *Tree = parseInput(ASTCtx);
+            if (!Tree)
+                return 1;
+
+            // Code generation
+            auto Timer = phaseTimer("irgen", "IR generation");
+            M = Kernel ? CodeGenerator.compileKernel(Tree, *Ctx, KernelWidth) : CodeGenerator.compile(Tree, *Ctx);
+        }
+        {
+            auto Timer = phaseTimer("opt", "Optimization");
+            CodeGenerator.optimize(*M, OptLevel);
+        }
+        if (Cache){
+            auto Timer = phaseTimer("cache-store", "Cache store");
+            Cache->store(CacheKey, *M);
+        }
+    }
+    if (Cache && CacheStats)
+        Cache->printStats(llvm::errs());
+
+    if (Run){
+        return runModule(std::move(M), std::move(Ctx), Start);
+    }
+    return emit(*M, *TM) ? 0 : 1;
+ }
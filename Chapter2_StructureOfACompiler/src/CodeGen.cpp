@@ -1,8 +1,15 @@
 #include "CodeGen.h"
-#include "llvm/ADT/StringMap.h"
+#include "LLVMCompat.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/StandardInstrumentations.h"
 #include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+#include <vector>
 
 using namespace llvm;
 
@@ -15,9 +22,20 @@ namespace {
         Type *Int32Ty;
         PointerType *PtrTy;
         Constant *Int32Zero;
+        Type *ValTy; // Type of the calculated values, either Int32Ty or a vector of it
 
         Value *V; // The current calculated value, which is updated through the tree traversal
-        StringMap<Value*> nameMap;// maps a variable name to the value returned from the calc_read() function
+        Value *Consts = nullptr; // The parameter holding the hoisted numbers, if any
+        unsigned NumConsts = 0;  // Numbers loaded from Consts so far
+        std::vector<Value*> VarValues;// maps a variable ID to the value returned from the calc_read() function
+        // The tree may be a DAG after simplification. Shared operations are
+        // translated once, and the value is reused within the same function.
+        DenseMap<Expr *, Value *> ExprValues;
+        SmallVector<Value *, 4> Results; // The values of the results of a WithDecl
+        // In main() and in a checked function, divisions which would trap
+        // branch to this block, which reports the error
+        BasicBlock *DivError = nullptr;
+        bool CheckDiv = false;
 
         public:
         explicit ToIRVisitor(Module *M) : M(M), Builder(M->getContext()){
@@ -25,6 +43,7 @@ namespace {
             Int32Ty = Type::getInt32Ty(M->getContext());
             PtrTy = PointerType::getUnqual(M->getContext());
             Int32Zero = ConstantInt::get(Int32Ty, 0, true);
+            ValTy = Int32Ty;
         }
 
         void run(AST *Tree){
@@ -40,8 +59,15 @@ namespace {
             BasicBlock *BB = BasicBlock::Create(M->getContext(), "entry", MainFn);
             Builder.SetInsertPoint(BB);
 
-            // Start the tree traversal
+            // Start the tree traversal. A bare expression is the only result.
+            ExprValues.clear();
+            Results.clear();
+            CheckDiv = true;
+            DivError = nullptr;
             Tree->accept(*this);
+            CheckDiv = false;
+            if (Results.empty())
+                Results.push_back(V);
 
             // Create a function prototype for the calc_write() function
             // calc_write() prints the computed value after tree traversal is completed.
@@ -52,26 +78,263 @@ namespace {
             // Defining the function instance for calc_write()
             Function *CalcWriteFn = Function::Create(CalcWriteFnTy, GlobalValue::ExternalLinkage, "calc_write", M);
 
-            // Call the calc_write() function with the result of the tree traversal
-            Builder.CreateCall(CalcWriteFnTy, CalcWriteFn, {V});
+            // Call the calc_write() function with each result of the tree traversal
+            for (Value *Result : Results)
+                Builder.CreateCall(CalcWriteFnTy, CalcWriteFn, {Result});
 
             // Return 0 from the main() function
             Builder.CreateRet(Int32Zero);
+
+            // A division which would trap calls calc_div_error() instead,
+            // which reports it, and main() returns 1
+            // LLVM IR: declare void @calc_div_error()
+            if (DivError){
+                FunctionType *DivErrorFnTy = FunctionType::get(VoidTy, false);
+                Function *DivErrorFn = Function::Create(DivErrorFnTy, GlobalValue::ExternalLinkage, "calc_div_error", M);
+                Builder.SetInsertPoint(DivError);
+                Builder.CreateCall(DivErrorFnTy, DivErrorFn);
+                Builder.CreateRet(ConstantInt::get(Int32Ty, 1));
+            }
+        }
+
+        // Emits a function which evaluates the expression for a batch of rows:
+        //   size_t Name(const int32_t *const *Cols, int32_t *Out, size_t N)
+        // Cols holds one column of N values per declared variable, in declaration
+        // order. The rows are processed Width at a time with <Width x i32>
+        // operations, and the remaining rows by a scalar loop. It returns N, or
+        // the first row which would divide by zero or INT_MIN by -1.
+        void runKernel(AST *Tree, unsigned Width, StringRef Name){
+            assert(isPowerOf2_32(Width) && "Kernel width must be a power of two");
+            LLVMContext &Ctx = M->getContext();
+            Type *SizeTy = M->getDataLayout().getIntPtrType(Ctx);
+            FunctionType *KernelFty = FunctionType::get(SizeTy, {PtrTy, PtrTy, SizeTy}, false);
+            Function *KernelFn = Function::Create(KernelFty, GlobalValue::ExternalLinkage, Name, M);
+            Argument *Cols = KernelFn->getArg(0);
+            Argument *Out = KernelFn->getArg(1);
+            Argument *N = KernelFn->getArg(2);
+            Cols->setName("cols");
+            Out->setName("out");
+            N->setName("n");
+            // The loops need no runtime checks for overlapping columns
+            Out->addAttr(Attribute::NoAlias);
+
+            DeclCollector Decls;
+            Tree->accept(Decls);
+            assert(Decls.Exprs.size() == 1 && "A kernel computes a single result");
+
+            BasicBlock *Entry = BasicBlock::Create(Ctx, "entry", KernelFn);
+            BasicBlock *ScalarCond = BasicBlock::Create(Ctx, "scalar.cond", KernelFn);
+            BasicBlock *ScalarBody = BasicBlock::Create(Ctx, "scalar.body", KernelFn);
+            BasicBlock *Exit = BasicBlock::Create(Ctx, "exit", KernelFn);
+
+            // The column pointers do not change inside the loops, so they are loaded once
+            Builder.SetInsertPoint(Entry);
+            SmallVector<Value *, 8> ColPtrs;
+            for (unsigned I = 0, E = Decls.Vars.size(); I != E; ++I){
+                Value *Slot = Builder.CreateConstInBoundsGEP1_64(PtrTy, Cols, I);
+                ColPtrs.push_back(Builder.CreateLoad(PtrTy, Slot, Twine(Decls.Vars[I]).concat(".col")));
+            }
+
+            // The vector loop handles the rows up to the last multiple of Width.
+            // The scalar loop continues with the index the vector loop stopped at.
+            // Divisions are checked in both loops. A failing vector iteration
+            // leaves its rows to the scalar loop, which finds the failing row.
+            CheckDiv = true;
+            SmallVector<std::pair<Value *, BasicBlock *>, 2> ScalarStarts = {{ConstantInt::get(SizeTy, 0), Entry}};
+            if (Width > 1){
+                BasicBlock *VecCond = BasicBlock::Create(Ctx, "vector.cond", KernelFn, ScalarCond);
+                BasicBlock *VecBody = BasicBlock::Create(Ctx, "vector.body", KernelFn, ScalarCond);
+                DivError = BasicBlock::Create(Ctx, "vector.div.error", KernelFn, ScalarCond);
+                Value *VecEnd = Builder.CreateAnd(N, ConstantInt::get(SizeTy, -static_cast<int64_t>(Width)), "n.vec");
+                Builder.CreateBr(VecCond);
+
+                Builder.SetInsertPoint(VecCond);
+                PHINode *VecIdx = Builder.CreatePHI(SizeTy, 2, "i");
+                VecIdx->addIncoming(ScalarStarts.front().first, Entry);
+                Builder.CreateCondBr(Builder.CreateICmpULT(VecIdx, VecEnd), VecBody, ScalarCond);
+
+                Builder.SetInsertPoint(VecBody);
+                emitRow(Decls, ColPtrs, Out, VecIdx, FixedVectorType::get(Int32Ty, Width));
+                VecIdx->addIncoming(Builder.CreateNUWAdd(VecIdx, ConstantInt::get(SizeTy, Width), "i.next"),
+                                    Builder.GetInsertBlock());
+                Builder.CreateBr(VecCond);
+
+                ScalarStarts = {{VecIdx, VecCond}};
+                if (!pred_empty(DivError)){
+                    Builder.SetInsertPoint(DivError);
+                    Builder.CreateBr(ScalarCond);
+                    ScalarStarts.push_back({VecIdx, DivError});
+                } else {
+                    DivError->eraseFromParent();
+                }
+            } else {
+                Builder.CreateBr(ScalarCond);
+            }
+
+            Builder.SetInsertPoint(ScalarCond);
+            PHINode *Idx = Builder.CreatePHI(SizeTy, ScalarStarts.size() + 1, "j");
+            for (auto &Start : ScalarStarts)
+                Idx->addIncoming(Start.first, Start.second);
+            Builder.CreateCondBr(Builder.CreateICmpULT(Idx, N), ScalarBody, Exit);
+
+            Builder.SetInsertPoint(ScalarBody);
+            DivError = nullptr;
+            emitRow(Decls, ColPtrs, Out, Idx, Int32Ty);
+            Idx->addIncoming(Builder.CreateNUWAdd(Idx, ConstantInt::get(SizeTy, 1), "j.next"), Builder.GetInsertBlock());
+            Builder.CreateBr(ScalarCond);
+            if (DivError){
+                Builder.SetInsertPoint(DivError);
+                Builder.CreateRet(Idx);
+            }
+            CheckDiv = false;
+
+            Builder.SetInsertPoint(Exit);
+            Builder.CreateRet(N);
+        }
+
+        void setVar(unsigned ID, Value *Val){
+            if (ID >= VarValues.size())
+                VarValues.resize(ID + 1);
+            VarValues[ID] = Val;
+        }
+
+        // Emits a function returning the value of the expression:
+        //   i32 Name(const i32 *Vars)
+        // The variables are loaded from Vars in declaration order. With
+        // HoistConstants, the numbers are loaded from a second parameter.
+        void runFunction(AST *Tree, StringRef Name, bool HoistConstants){
+            SmallVector<Type *, 2> Params = {PtrTy};
+            if (HoistConstants)
+                Params.push_back(PtrTy);
+            FunctionType *Fty = FunctionType::get(Int32Ty, Params, false);
+            Function *Fn = Function::Create(Fty, GlobalValue::ExternalLinkage, Name, M);
+            Argument *Vars = Fn->getArg(0);
+            Vars->setName("vars");
+            Consts = nullptr;
+            NumConsts = 0;
+            if (HoistConstants){
+                Consts = Fn->getArg(1);
+                Consts->setName("consts");
+            }
+
+            DeclCollector Decls;
+            Tree->accept(Decls);
+            assert(Decls.Exprs.size() == 1 && "Use runResultsFunction() for several results");
+
+            Builder.SetInsertPoint(BasicBlock::Create(M->getContext(), "entry", Fn));
+            loadVars(Decls, Vars);
+            Decls.Exprs.front()->accept(*this);
+            Builder.CreateRet(V);
+            Consts = nullptr;
+        }
+
+        // Emits a function storing the value of every result:
+        //   bool Name(const i32 *Vars, i32 *Results)
+        // It returns false instead of executing a division which would trap.
+        // With HoistConstants, the numbers are loaded from a third parameter.
+        void runResultsFunction(AST *Tree, StringRef Name, bool HoistConstants){
+            Type *BoolTy = Type::getInt1Ty(M->getContext());
+            SmallVector<Type *, 3> Params = {PtrTy, PtrTy};
+            if (HoistConstants)
+                Params.push_back(PtrTy);
+            FunctionType *Fty = FunctionType::get(BoolTy, Params, false);
+            Function *Fn = Function::Create(Fty, GlobalValue::ExternalLinkage, Name, M);
+            Fn->addRetAttr(Attribute::ZExt); // The C ABI of bool
+            Argument *Vars = Fn->getArg(0);
+            Argument *Out = Fn->getArg(1);
+            Vars->setName("vars");
+            Out->setName("results");
+            Consts = nullptr;
+            NumConsts = 0;
+            if (HoistConstants){
+                Consts = Fn->getArg(2);
+                Consts->setName("consts");
+            }
+
+            DeclCollector Decls;
+            Tree->accept(Decls);
+
+            Builder.SetInsertPoint(BasicBlock::Create(M->getContext(), "entry", Fn));
+            loadVars(Decls, Vars);
+            CheckDiv = true;
+            DivError = nullptr;
+            // The results are stored once all of them are known, so that
+            // Results is left alone on an error
+            SmallVector<Value *, 4> Values;
+            for (Expr *E : Decls.Exprs){
+                E->accept(*this);
+                Values.push_back(V);
+            }
+            for (unsigned K = 0, E = Values.size(); K != E; ++K)
+                Builder.CreateStore(Values[K], Builder.CreateConstInBoundsGEP1_64(Int32Ty, Out, K));
+            Builder.CreateRet(ConstantInt::getTrue(BoolTy));
+            if (DivError){
+                Builder.SetInsertPoint(DivError);
+                Builder.CreateRet(ConstantInt::getFalse(BoolTy));
+            }
+            CheckDiv = false;
+            Consts = nullptr;
+        }
+
+        // Continues in a new block if Left / Right is defined, and branches
+        // to DivError if it divides by zero or INT_MIN by -1; for vectors,
+        // if any element does. The values computed so far dominate the new
+        // block, so they stay reusable.
+        void checkDiv(Value *Left, Value *Right){
+            Function *Fn = Builder.GetInsertBlock()->getParent();
+            if (!DivError)
+                DivError = BasicBlock::Create(M->getContext(), "div.error", Fn);
+            Value *ByZero = Builder.CreateICmpEQ(Right, ConstantInt::get(ValTy, 0));
+            Value *Overflow = Builder.CreateAnd(Builder.CreateICmpEQ(Left, ConstantInt::get(ValTy, INT32_MIN, true)),
+                                                Builder.CreateICmpEQ(Right, ConstantInt::get(ValTy, -1, true)));
+            Value *Fails = Builder.CreateOr(ByZero, Overflow);
+            if (ValTy->isVectorTy())
+                Fails = Builder.CreateOrReduce(Fails);
+            BasicBlock *Ok = BasicBlock::Create(M->getContext(), "div.ok", Fn, DivError);
+            Builder.CreateCondBr(Fails, DivError, Ok);
+            Builder.SetInsertPoint(Ok);
+        }
+
+        // Loads the variables from Vars in declaration order
+        void loadVars(DeclCollector &Decls, Value *Vars){
+            VarValues.clear();
+            ExprValues.clear();
+            for (unsigned I = 0, E = Decls.Vars.size(); I != E; ++I){
+                Value *Ptr = Builder.CreateConstInBoundsGEP1_64(Int32Ty, Vars, I);
+                setVar(Decls.IDs[I], Builder.CreateLoad(Int32Ty, Ptr, Decls.Vars[I]));
+            }
+        }
+
+        // Loads the variables of the rows starting at Idx, evaluates the expression
+        // and stores the results. Ty is Int32Ty or a vector of it.
+        void emitRow(DeclCollector &Decls, ArrayRef<Value *> ColPtrs, Value *Out, Value *Idx, Type *Ty){
+            ValTy = Ty;
+            ExprValues.clear();
+            for (unsigned I = 0, E = Decls.Vars.size(); I != E; ++I){
+                Value *Ptr = Builder.CreateInBoundsGEP(Int32Ty, ColPtrs[I], Idx);
+                setVar(Decls.IDs[I], Builder.CreateAlignedLoad(Ty, Ptr, Align(4), Decls.Vars[I]));
+            }
+            Decls.Exprs.front()->accept(*this);
+            Value *OutPtr = Builder.CreateInBoundsGEP(Int32Ty, Out, Idx);
+            Builder.CreateAlignedStore(V, OutPtr, Align(4));
+            ValTy = Int32Ty;
         }
 
-        
         virtual void visit(WithDecl &Node) override {
             // In order to evaluate a WithDecl expression, we first have to obtain the variable
             // from the user. This is done with the calc_read() function.
             // LLVM IR: declare i32 @calc_read(ptr)
+            // A tree with several results may declare no variables at all.
             FunctionType *ReadFty = FunctionType::get(Int32Ty, {PtrTy}, false);
-            Function *ReadFn = Function::Create(ReadFty, GlobalValue::ExternalLinkage, "calc_read", M);
+            Function *ReadFn = nullptr;
+            if (!Node.getIDs().empty())
+                ReadFn = Function::Create(ReadFty, GlobalValue::ExternalLinkage, "calc_read", M);
 
             // Loop through all the variable names and process them
-            for (auto I = Node.begin(), E = Node.end(); I != E; ++I)
+            for (unsigned I = 0, E = Node.getIDs().size(); I != E; ++I)
             {
                 // For each variable, a string with a variable name is created
-                StringRef Var = *I;
+                StringRef Var = Node.begin()[I];
                 Constant *StrText = ConstantDataArray::getString(M->getContext(), Var);
                 GlobalVariable *Str = new GlobalVariable(*M, StrText->getType(),
                                                          /*isConstant=*/true,
@@ -82,29 +345,46 @@ namespace {
                 // Create an IR call to the calc_read() function
                 CallInst *Call = Builder.CreateCall(ReadFty, ReadFn, {Str});
 
-                // Returned value is stored in the nameMap for later use
-                nameMap[Var] = Call;
+                // Returned value is stored in VarValues for later use
+                setVar(Node.getIDs()[I], Call);
             }
 
-            // After obtaining variables, continue tree traversal with the expression
-            Node.getExpr()->accept(*this);
+            // After obtaining variables, continue tree traversal with the
+            // expressions. Their values stay in ExprValues, so subexpressions
+            // shared by several results are computed once.
+            Results.clear();
+            for (Expr *E : Node.getExprs()){
+                E->accept(*this);
+                Results.push_back(V);
+            }
         }
 
         virtual void visit(Factor &Node) override {
             // A factor is either a variable or a number.
             if(Node.getKind() == Factor::Ident){
-                // Values of variables are looked up from nameMap map.
-                V = nameMap[Node.getVal()];
+                // Values of variables are looked up by their ID.
+                V = VarValues[Node.getID()];
+            } else if (Consts){
+                // A hoisted number is the next element of the constants
+                Value *Ptr = Builder.CreateConstInBoundsGEP1_64(Int32Ty, Consts, NumConsts++);
+                V = Builder.CreateLoad(Int32Ty, Ptr, "c");
             } else {
                 // Numbers are converted into integers, which are then 
                 // turned into constant integers
                 int intval{0};
                 Node.getVal().getAsInteger(10, intval);
-                V = ConstantInt::get(Int32Ty, intval,true);
+                V = ConstantInt::get(ValTy, intval,true);
             }
         }
 
         virtual void visit(BinaryOp &Node) override {
+            // With hoisted numbers, every occurrence of a shared node is
+            // translated, so that the numbers are counted like in the tree
+            auto Cached = ExprValues.find(&Node);
+            if (!Consts && Cached != ExprValues.end()){
+                V = Cached->second;
+                return;
+            }
             Node.getLeft()->accept(*this);
             Value *Left = V;
             Node.getRight()->accept(*this);
@@ -112,26 +392,82 @@ namespace {
             // Select the right operator for binary ops
             switch (Node.getOperator()){
             case BinaryOp::Plus:
-                V = Builder.CreateNSWAdd(Left, Right);
+                V = Builder.CreateAdd(Left, Right);
                 break;
             case BinaryOp::Minus:
-                V = Builder.CreateNSWSub(Left, Right);
+                V = Builder.CreateSub(Left, Right);
                 break;
             case BinaryOp::Mul:
-                V = Builder.CreateNSWMul(Left, Right);
+                V = Builder.CreateMul(Left, Right);
                 break;
             case BinaryOp::Div:
+                if (CheckDiv)
+                    checkDiv(Left, Right);
                 V = Builder.CreateSDiv(Left, Right);
                 break;
             }
+            ExprValues[&Node] = V;
         }
     };
 } // unnamed namespace
 
-void CodeGen::compile(AST *Tree){
-    LLVMContext Ctx; // Create global context
-    Module *M = new Module("calc.expr", Ctx); // Create module
-    ToIRVisitor ToIR(M);
+std::unique_ptr<Module> CodeGen::createModule(StringRef Name, LLVMContext &Ctx){
+    auto M = std::make_unique<Module>(Name, Ctx);
+    if (TM){
+        M->setDataLayout(TM->createDataLayout());
+        M->setTargetTriple(TM->getTargetTriple().getTriple());
+    }
+    return M;
+}
+
+std::unique_ptr<Module> CodeGen::compile(AST *Tree, LLVMContext &Ctx){
+    auto M = createModule("calc.expr", Ctx); // Create module
+    ToIRVisitor ToIR(M.get());
     ToIR.run(Tree); // Perform tree traversal
-    M->print(outs(), nullptr); // Dump generated IR to console
-}
\ No newline at end of file
+    return M;
+}
+
+std::unique_ptr<Module> CodeGen::compileKernel(AST *Tree, LLVMContext &Ctx, unsigned Width, StringRef Name){
+    auto M = createModule("calc.kernel", Ctx);
+    ToIRVisitor ToIR(M.get());
+    ToIR.runKernel(Tree, Width, Name);
+    return M;
+}
+
+void CodeGen::compileFunction(AST *Tree, Module &M, StringRef Name, bool HoistConstants){
+    ToIRVisitor ToIR(&M);
+    ToIR.runFunction(Tree, Name, HoistConstants);
+}
+
+void CodeGen::compileResultsFunction(AST *Tree, Module &M, StringRef Name, bool HoistConstants){
+    ToIRVisitor ToIR(&M);
+    ToIR.runResultsFunction(Tree, Name, HoistConstants);
+}
+
+void CodeGen::optimize(Module &M, unsigned OptLevel){
+    // The analysis managers of the new pass manager, one for each IR unit
+    LoopAnalysisManager LAM;
+    FunctionAnalysisManager FAM;
+    CGSCCAnalysisManager CGAM;
+    ModuleAnalysisManager MAM;
+
+    // The standard instrumentations implement options like -time-passes
+    // and -print-after-all for the new pass manager
+    PassInstrumentationCallbacks PIC;
+    compat::StandardInstrumentations SI(M.getContext(), /*DebugLogging=*/false);
+    SI.registerCallbacks(PIC, MAM, FAM);
+
+    PassBuilder PB(TM, PipelineTuningOptions(), {}, &PIC);
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    OptimizationLevel Levels[] = {OptimizationLevel::O0, OptimizationLevel::O1,
+                                  OptimizationLevel::O2, OptimizationLevel::O3};
+    assert(OptLevel < std::size(Levels) && "Invalid optimization level");
+    ModulePassManager MPM = OptLevel == 0 ? PB.buildO0DefaultPipeline(Levels[0])
+                                          : PB.buildPerModuleDefaultPipeline(Levels[OptLevel]);
+    MPM.run(M, MAM);
+}
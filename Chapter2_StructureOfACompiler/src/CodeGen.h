@@ -1,11 +1,65 @@
 #ifndef CODEGEN_H
 #define CODEGEN_H
 #include "AST.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+#include <memory>
 class CodeGen{
+    // The target the code is generated for. Without one, modules carry no
+    // data layout and the optimizer only assumes a generic target.
+    llvm::TargetMachine *TM;
+
+    std::unique_ptr<llvm::Module> createModule(llvm::StringRef Name, llvm::LLVMContext &Ctx);
 public:
-    void compile(AST *Tree);
+    explicit CodeGen(llvm::TargetMachine *TM = nullptr) : TM(TM) {}
+
+    // Translates the tree into a module owned by the caller. The module
+    // lives in Ctx, which therefore must outlive it. main() reads every
+    // variable once and writes the results in order.
+    std::unique_ptr<llvm::Module> compile(AST *Tree, llvm::LLVMContext &Ctx);
+
+    // Like compile(), but instead of main() the module contains a function
+    //   size_t Name(const int32_t *const *Cols, int32_t *Out, size_t N)
+    // evaluating the expression, which must have a single result, for N
+    // rows at once. Cols[I] points to the N values of the I-th declared
+    // variable, and Out must not overlap any column. Width rows are computed
+    // per loop iteration using vector operations; Width must be a power of two.
+    // It returns N, or the index of the first row which would divide by zero
+    // or INT_MIN by -1; the rows before it have been stored.
+    std::unique_ptr<llvm::Module> compileKernel(AST *Tree, llvm::LLVMContext &Ctx, unsigned Width,
+                                                llvm::StringRef Name = "calc_kernel");
+
+    // Adds a function to M which evaluates the expression for one set of values:
+    //   int32_t Name(const int32_t *Vars)
+    // Vars[I] is the value of the I-th declared variable, and the tree must
+    // have a single result. Unlike main(), the function does not call into
+    // the runtime, so many expressions can be compiled into one module.
+    //
+    // With HoistConstants, the numbers become parameters as well:
+    //   int32_t Name(const int32_t *Vars, const int32_t *Consts)
+    // Consts[K] is the K-th number of the tree in pre-order, counting every
+    // occurrence of a shared node. The function then serves all expressions
+    // which differ only in their numbers (see ShapeRegistry).
+    void compileFunction(AST *Tree, llvm::Module &M, llvm::StringRef Name, bool HoistConstants = false);
+
+    // Like compileFunction(), for a tree with any number of results:
+    //   bool Name(const int32_t *Vars, int32_t *Results)
+    // Results[K] receives the value of the K-th result. The variables are
+    // loaded once, and subexpressions shared by the results are computed once.
+    // Divisions are checked: instead of dividing by zero or INT_MIN by -1,
+    // which traps, the function returns false and leaves Results unchanged.
+    // With HoistConstants, the numbers are passed like for compileFunction():
+    //   bool Name(const int32_t *Vars, int32_t *Results, const int32_t *Consts)
+    void compileResultsFunction(AST *Tree, llvm::Module &M, llvm::StringRef Name, bool HoistConstants = false);
+
+    // Runs the default optimization pipeline of the given level (0 to 3)
+    // on the module. With a target machine, the vectorizer and other passes
+    // use its cost model, e.g. the vector width of the selected CPU.
+    // With -time-passes, the time of each pass is reported.
+    void optimize(llvm::Module &M, unsigned OptLevel);
 };
 
 
 
-#endif
\ No newline at end of file
+#endif
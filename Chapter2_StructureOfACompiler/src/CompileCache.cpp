@@ -0,0 +1,108 @@
+#include "CompileCache.h"
+#include "Lexer.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/SHA1.h"
+
+using namespace llvm;
+
+// Must be changed whenever the generated code changes for the same input
+// and options, to invalidate existing entries.
+static const char CacheFormat[] = "calc-cache-4";
+
+Expected<std::unique_ptr<CompileCache>> CompileCache::create(StringRef Dir, StringRef PolicyStr){
+    Expected<CachePruningPolicy> Policy = parseCachePruningPolicy(PolicyStr);
+    if (!Policy)
+        return Policy.takeError();
+    if (std::error_code EC = sys::fs::create_directories(Dir))
+        return createStringError(EC, "cannot create cache directory %s", Dir.str().c_str());
+    return std::unique_ptr<CompileCache>(new CompileCache(Dir, *Policy));
+}
+
+std::string CompileCache::computeKey(StringRef Input, StringRef Options){
+    SHA1 Hasher;
+    auto AddString = [&](StringRef S){
+        // The length keeps adjacent strings apart, e.g. tokens "a","b" and "ab"
+        uint32_t Len = S.size();
+        Hasher.update(ArrayRef<uint8_t>(reinterpret_cast<const uint8_t *>(&Len), sizeof(Len)));
+        Hasher.update(S);
+    };
+    AddString(CacheFormat);
+    AddString(LLVM_VERSION_STRING);
+    AddString(Options);
+    Lexer Lex(Input);
+    Token Tok;
+    do {
+        Lex.next(Tok);
+        uint8_t Kind = Tok.getKind();
+        Hasher.update(ArrayRef<uint8_t>(Kind));
+        AddString(Tok.getText());
+    } while (!Tok.is(Token::eoi));
+    return toHex(Hasher.final(), /*LowerCase=*/true);
+}
+
+std::string CompileCache::getEntryPath(StringRef Key) const {
+    // pruneCache() only considers files starting with "llvmcache-"
+    SmallString<128> Path(Dir);
+    sys::path::append(Path, "llvmcache-" + Key);
+    return std::string(Path);
+}
+
+std::unique_ptr<Module> CompileCache::lookup(StringRef Key, LLVMContext &Ctx){
+    std::string Path = getEntryPath(Key);
+    int FD;
+    if (sys::fs::openFileForRead(Path, FD)){
+        ++Misses;
+        return nullptr;
+    }
+    // Record the use, as the pruning removes the entries used least recently
+    sys::fs::setLastAccessAndModificationTime(FD, std::chrono::system_clock::now());
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer = MemoryBuffer::getOpenFile(sys::fs::convertFDToNativeFile(FD), Path, -1);
+    sys::Process::SafelyCloseFileDescriptor(FD);
+    if (Buffer){
+        Expected<std::unique_ptr<Module>> M = parseBitcodeFile((*Buffer)->getMemBufferRef(), Ctx);
+        if (M){
+            ++Hits;
+            return std::move(*M);
+        }
+        // A damaged entry is simply replaced by the next store
+        consumeError(M.takeError());
+    }
+    ++Misses;
+    return nullptr;
+}
+
+void CompileCache::store(StringRef Key, const Module &M){
+    SmallString<128> Model(Dir);
+    sys::path::append(Model, "calc-tmp-%%%%%%%%.bc");
+    Expected<sys::fs::TempFile> Temp = sys::fs::TempFile::create(Model);
+    if (!Temp){
+        consumeError(Temp.takeError());
+        return;
+    }
+    {
+        raw_fd_ostream OS(Temp->FD, /*shouldClose=*/false);
+        WriteBitcodeToFile(M, OS);
+    }
+    // The rename is atomic, so concurrent processes storing the same entry
+    // are harmless: each of them replaces the file with identical content.
+    if (Error E = Temp->keep(getEntryPath(Key))){
+        consumeError(std::move(E));
+        return;
+    }
+    ++Stores;
+    pruneCache(Dir, Policy);
+}
+
+void CompileCache::printStats(raw_ostream &OS) const {
+    OS << "Cache statistics (" << Dir << "):\n";
+    OS << "  hits:   " << Hits << "\n";
+    OS << "  misses: " << Misses << "\n";
+    OS << "  stores: " << Stores << "\n";
+}
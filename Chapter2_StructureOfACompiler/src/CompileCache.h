@@ -0,0 +1,51 @@
+#ifndef COMPILECACHE_H
+#define COMPILECACHE_H
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+#include <atomic>
+#include <memory>
+#include <string>
+
+// An on-disk cache of compiled expressions, shared by all calc processes
+// using the same directory. An entry holds the bitcode of the optimized
+// module and is found by a hash of the expression's tokens and the options
+// affecting the generated code, so a hit skips parsing, semantic analysis,
+// code generation and optimization.
+//
+// Entries are written to a temporary file which is then renamed, so a
+// reader never sees a partial entry. The cache is kept below the size of
+// the pruning policy by removing the least recently used entries.
+class CompileCache{
+    std::string Dir;
+    llvm::CachePruningPolicy Policy;
+    std::atomic<unsigned> Hits{0};
+    std::atomic<unsigned> Misses{0};
+    std::atomic<unsigned> Stores{0};
+
+    CompileCache(llvm::StringRef Dir, llvm::CachePruningPolicy Policy) : Dir(Dir.str()), Policy(Policy) {}
+    std::string getEntryPath(llvm::StringRef Key) const;
+
+public:
+    // Creates the directory if needed. PolicyStr uses the syntax of
+    // llvm::parseCachePruningPolicy(), e.g. "cache_size_bytes=64m".
+    static llvm::Expected<std::unique_ptr<CompileCache>> create(llvm::StringRef Dir, llvm::StringRef PolicyStr);
+
+    // Hashes the tokens of Input, so that whitespace does not matter, and
+    // Options, which must describe everything else the output depends on.
+    static std::string computeKey(llvm::StringRef Input, llvm::StringRef Options);
+
+    // Returns the module stored under Key, or nullptr if there is none.
+    std::unique_ptr<llvm::Module> lookup(llvm::StringRef Key, llvm::LLVMContext &Ctx);
+
+    // Stores M under Key. Failures are ignored, as the cache is only an
+    // optimization.
+    void store(llvm::StringRef Key, const llvm::Module &M);
+
+    void printStats(llvm::raw_ostream &OS) const;
+};
+
+#endif
@@ -0,0 +1,331 @@
+#include "Daemon.h"
+#include "CodeGen.h"
+#include "Parser.h"
+#include "Sema.h"
+#include "Simplify.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace llvm;
+
+namespace {
+    // Frames larger than this are rejected instead of allocated
+    constexpr uint32_t MaxFrameSize = 1u << 30;
+
+    Error errnoError(const Twine &Message){
+        return createStringError(std::error_code(errno, std::generic_category()), Message + ": " + std::strerror(errno));
+    }
+
+    bool writeAll(int FD, const char *Data, size_t Size){
+        while (Size){
+            ssize_t N = ::write(FD, Data, Size);
+            if (N < 0 && errno == EINTR)
+                continue;
+            if (N <= 0)
+                return false;
+            Data += N;
+            Size -= N;
+        }
+        return true;
+    }
+
+    bool readAll(int FD, char *Data, size_t Size){
+        while (Size){
+            ssize_t N = ::read(FD, Data, Size);
+            if (N < 0 && errno == EINTR)
+                continue;
+            if (N <= 0)
+                return false;
+            Data += N;
+            Size -= N;
+        }
+        return true;
+    }
+
+    bool writeFrame(int FD, StringRef Payload){
+        uint32_t Size = Payload.size();
+        return writeAll(FD, reinterpret_cast<const char *>(&Size), sizeof(Size)) &&
+               writeAll(FD, Payload.data(), Payload.size());
+    }
+
+    // Returns false at the end of the connection or on a malformed frame
+    bool readFrame(int FD, std::string &Payload){
+        uint32_t Size;
+        if (!readAll(FD, reinterpret_cast<char *>(&Size), sizeof(Size)) || Size > MaxFrameSize)
+            return false;
+        Payload.resize(Size);
+        return readAll(FD, &Payload[0], Size);
+    }
+
+    // Returns true if the process at the other end of the connected
+    // socket FD runs as the same user
+    bool isSameUser(int FD){
+        ucred Cred;
+        socklen_t Size = sizeof(Cred);
+        return !::getsockopt(FD, SOL_SOCKET, SO_PEERCRED, &Cred, &Size) && Cred.uid == ::getuid();
+    }
+
+    std::string errorResponse(const Twine &Message){
+        return ("\1" + Message).str();
+    }
+
+    void appendInt(std::string &S, int32_t V){
+        S.append(reinterpret_cast<const char *>(&V), sizeof(V));
+    }
+
+    // Reads the values like calc_read() in batch mode: every character
+    // other than a digit or a '-' before a digit separates values, and the
+    // numbers wrap around instead of overflowing.
+    void parseValues(StringRef Text, calc_input_format Format, std::vector<int32_t> &Values){
+        if (Format == CALC_INPUT_BINARY){
+            Values.resize(Text.size() / sizeof(int32_t));
+            if (!Values.empty())
+                std::memcpy(Values.data(), Text.data(), Values.size() * sizeof(int32_t));
+            return;
+        }
+        const char *P = Text.begin(), *End = Text.end();
+        while (P != End){
+            bool Neg = *P == '-' && P + 1 != End && unsigned(P[1] - '0') < 10;
+            if (!Neg && unsigned(*P - '0') >= 10){
+                ++P;
+                continue;
+            }
+            P += Neg;
+            uint32_t V = 0;
+            for (; P != End && unsigned(*P - '0') < 10; ++P)
+                V = V * 10 + unsigned(*P - '0');
+            Values.push_back(static_cast<int32_t>(Neg ? 0u - V : V));
+        }
+    }
+} // unnamed namespace
+
+namespace calcd {
+
+Expected<std::string> getDefaultSocketPath(){
+    SmallString<128> Path;
+    // The runtime directory is private to the user already
+    if (const char *RuntimeDir = std::getenv("XDG_RUNTIME_DIR"); RuntimeDir && sys::path::is_absolute(RuntimeDir)){
+        sys::path::append(Path, RuntimeDir, "calc.sock");
+        return std::string(Path.str());
+    }
+    // Anyone may create files in the temporary directory, so the socket is
+    // placed into a directory which another user cannot have prepared
+    sys::path::system_temp_directory(/*ErasedOnReboot=*/true, Path);
+    sys::path::append(Path, "calc-" + Twine(::getuid()));
+    if (::mkdir(Path.c_str(), 0700) && errno != EEXIST)
+        return errnoError(Path);
+    struct stat Stat;
+    if (::lstat(Path.c_str(), &Stat))
+        return errnoError(Path);
+    if (!S_ISDIR(Stat.st_mode) || Stat.st_uid != ::getuid() || (Stat.st_mode & 077))
+        return createStringError(inconvertibleErrorCode(), "%s: not a directory private to the user", Path.c_str());
+    sys::path::append(Path, "calc.sock");
+    return std::string(Path.str());
+}
+
+Expected<std::unique_ptr<Server>> Server::create(TargetMachine &TM, unsigned OptLevel, unsigned JITThreshold){
+    Expected<std::unique_ptr<calc::Engine>> Engine = calc::Engine::create(OptLevel, JITThreshold);
+    if (!Engine)
+        return Engine.takeError();
+    return std::unique_ptr<Server>(new Server(std::move(*Engine), TM, OptLevel));
+}
+
+std::string Server::evaluate(StringRef Request){
+    uint32_t ExprSize;
+    if (Request.size() < 2 + sizeof(ExprSize))
+        return errorResponse("malformed request");
+    auto Format = static_cast<calc_input_format>(Request[1]);
+    std::memcpy(&ExprSize, Request.data() + 2, sizeof(ExprSize));
+    Request = Request.drop_front(2 + sizeof(ExprSize));
+    if (ExprSize > Request.size())
+        return errorResponse("malformed request");
+
+    Expected<calc::Handle> H = Engine->compile(Request.take_front(ExprSize));
+    if (!H)
+        return errorResponse(toString(H.takeError()));
+    std::vector<int32_t> Values;
+    parseValues(Request.drop_front(ExprSize), Format, Values);
+
+    // Like calc_eval_file(), trailing values which do not fill a row are ignored
+    size_t NumVars = H->getVars().size();
+    size_t Rows = NumVars ? Values.size() / NumVars : 1;
+    std::string Response(1 + Rows * sizeof(int32_t), '\0');
+    for (size_t Row = 0; Row != Rows; ++Row){
+        // A bad row fails the request, and the daemon keeps running
+        int32_t Result;
+        if (!H->eval(Values.data() + Row * NumVars, Result))
+            return errorResponse("division by zero or of INT_MIN by -1 in row " + Twine(Row + 1));
+        std::memcpy(&Response[1 + Row * sizeof(int32_t)], &Result, sizeof(Result));
+    }
+    return Response;
+}
+
+std::string Server::emitObject(StringRef Expr){
+    {
+        std::lock_guard<std::mutex> Lock(TMMutex);
+        auto It = Objects.find(Expr);
+        if (It != Objects.end())
+            return It->second;
+    }
+    std::string Diags;
+    raw_string_ostream OS(Diags);
+    ASTContext ASTCtx;
+    Lexer Lex(Expr);
+    Parser Parser(Lex, ASTCtx, OS);
+    AST *Tree = Parser.parse();
+    if (!Tree || Parser.hasError() || Sema(OS).semantic(Tree))
+        return errorResponse(OS.str());
+    Tree = Simplifier(ASTCtx).simplify(Tree);
+
+    // The target machine caches its subtargets, so it is used by one
+    // request at a time
+    std::lock_guard<std::mutex> Lock(TMMutex);
+    LLVMContext Ctx;
+    CodeGen CodeGenerator(&TM);
+    std::unique_ptr<Module> M = CodeGenerator.compile(Tree, Ctx);
+    CodeGenerator.optimize(*M, OptLevel);
+    SmallVector<char, 0> Object;
+    raw_svector_ostream Out(Object);
+    legacy::PassManager PM;
+    if (TM.addPassesToEmitFile(PM, Out, nullptr, CGFT_ObjectFile))
+        return errorResponse("the target cannot emit object files");
+    PM.run(*M);
+    std::string &Response = Objects[Expr];
+    Response.assign(1, '\0');
+    Response.append(Object.begin(), Object.end());
+    return Response;
+}
+
+void Server::serveConnection(int FD){
+    std::string Request;
+    while (readFrame(FD, Request)){
+        std::string Response;
+        if (!Request.empty() && Request[0] == Evaluate)
+            Response = evaluate(Request);
+        else if (!Request.empty() && Request[0] == EmitObject)
+            Response = emitObject(StringRef(Request).drop_front());
+        else
+            Response = errorResponse("unknown request");
+        if (!writeFrame(FD, Response))
+            break;
+    }
+    ::close(FD);
+}
+
+Error Server::serve(StringRef SocketPath){
+    sockaddr_un Addr{};
+    Addr.sun_family = AF_UNIX;
+    if (SocketPath.size() >= sizeof(Addr.sun_path))
+        return createStringError(inconvertibleErrorCode(), "socket path too long: %s", SocketPath.str().c_str());
+    std::memcpy(Addr.sun_path, SocketPath.data(), SocketPath.size());
+
+    int FD = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (FD < 0)
+        return errnoError("socket");
+    // A socket left behind by a daemon which was killed would make bind() fail
+    ::unlink(Addr.sun_path);
+    // The socket is created accessible only to the user, rather than
+    // restricted after bind(). No other thread runs yet, so changing the
+    // umask of the process is safe.
+    mode_t Mask = ::umask(0177);
+    int Bound = ::bind(FD, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr));
+    ::umask(Mask);
+    if (Bound || ::listen(FD, SOMAXCONN)){
+        Error Err = errnoError(SocketPath);
+        ::close(FD);
+        return Err;
+    }
+
+    // A client which disconnects early must not kill the daemon
+    std::signal(SIGPIPE, SIG_IGN);
+
+    for (;;){
+        int Conn = ::accept4(FD, nullptr, nullptr, SOCK_CLOEXEC);
+        if (Conn < 0){
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            Error Err = errnoError("accept");
+            ::close(FD);
+            return Err;
+        }
+        // The socket may be one the user placed where others can reach it
+        if (!isSameUser(Conn)){
+            ::close(Conn);
+            continue;
+        }
+        std::thread(&Server::serveConnection, this, Conn).detach();
+    }
+}
+
+Expected<std::unique_ptr<Client>> Client::connect(StringRef SocketPath){
+    sockaddr_un Addr{};
+    Addr.sun_family = AF_UNIX;
+    if (SocketPath.size() >= sizeof(Addr.sun_path))
+        return createStringError(inconvertibleErrorCode(), "socket path too long: %s", SocketPath.str().c_str());
+    std::memcpy(Addr.sun_path, SocketPath.data(), SocketPath.size());
+
+    int FD = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (FD < 0)
+        return errnoError("socket");
+    if (::connect(FD, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr))){
+        Error Err = errnoError("cannot connect to " + SocketPath + ", is calc --daemon running?");
+        ::close(FD);
+        return Err;
+    }
+    // Another user could have bound the socket first, and would receive
+    // the expressions and values, or hand out an object file of its own
+    if (!isSameUser(FD)){
+        ::close(FD);
+        return createStringError(inconvertibleErrorCode(), "%s belongs to a daemon of another user",
+                                 SocketPath.str().c_str());
+    }
+    return std::unique_ptr<Client>(new Client(FD));
+}
+
+Client::~Client(){
+    ::close(FD);
+}
+
+Expected<std::string> Client::request(StringRef Request){
+    std::string Response;
+    if (!writeFrame(FD, Request) || !readFrame(FD, Response) || Response.empty())
+        return createStringError(inconvertibleErrorCode(), "the daemon closed the connection");
+    if (Response[0] != 0)
+        return createStringError(inconvertibleErrorCode(), StringRef(Response).drop_front().rtrim());
+    return Response.substr(1);
+}
+
+Expected<std::vector<int32_t>> Client::evaluate(StringRef Expr, StringRef Values, calc_input_format Format){
+    std::string Request(1, Evaluate);
+    Request += static_cast<char>(Format);
+    appendInt(Request, static_cast<int32_t>(Expr.size()));
+    Request += Expr;
+    Request += Values;
+    Expected<std::string> Response = request(Request);
+    if (!Response)
+        return Response.takeError();
+    std::vector<int32_t> Results(Response->size() / sizeof(int32_t));
+    if (!Results.empty())
+        std::memcpy(Results.data(), Response->data(), Results.size() * sizeof(int32_t));
+    return Results;
+}
+
+Expected<std::string> Client::emitObject(StringRef Expr){
+    return request((Twine(static_cast<char>(EmitObject)) + Expr).str());
+}
+
+} // namespace calcd
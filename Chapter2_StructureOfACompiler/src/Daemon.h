@@ -0,0 +1,81 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+#include "Engine.h"
+#include "RTCalc.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Target/TargetMachine.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// calc --daemon keeps LLVM initialized and a JIT warm in a long running
+// process, which compiles and evaluates expressions for clients connecting
+// to a Unix domain socket. calc --client is such a client.
+//
+// Every message, in both directions, is a frame of a native-endian uint32
+// length followed by that many bytes. The first byte of a request selects
+// the operation:
+//   'e' <uint8 format> <uint32 n> <n bytes expression> <values>
+//       Evaluates the expression for every row of the values, which are
+//       CSV text or int32 values like -input (see RTCalc.h).
+//   'o' <expression>
+//       Compiles the expression into an object file with main(), like
+//       calc -o expr.o. The object files are kept for repeated requests.
+// The first byte of a response is 0 on success, followed by the int32
+// results or the object file, or 1 followed by an error message. A
+// connection may carry any number of requests.
+namespace calcd {
+    enum Operation : char { Evaluate = 'e', EmitObject = 'o' };
+
+    // Returns the socket used if none is given: calc.sock in
+    // $XDG_RUNTIME_DIR, or else in the directory calc-<uid> of the
+    // temporary directory. That directory is created if needed, and
+    // rejected unless it belongs to the user and only the user can access it.
+    llvm::Expected<std::string> getDefaultSocketPath();
+
+    class Server{
+        std::unique_ptr<calc::Engine> Engine; // Compiles and caches the evaluated expressions
+        llvm::TargetMachine &TM;
+        std::mutex TMMutex; // The target machine emits one object file at a time
+        llvm::StringMap<std::string> Objects; // The emitted object files by expression, guarded by TMMutex
+        unsigned OptLevel;
+
+        Server(std::unique_ptr<calc::Engine> Engine, llvm::TargetMachine &TM, unsigned OptLevel)
+            : Engine(std::move(Engine)), TM(TM), OptLevel(OptLevel) {}
+
+        void serveConnection(int FD);
+        std::string evaluate(llvm::StringRef Request);
+        std::string emitObject(llvm::StringRef Expr);
+
+    public:
+        // JITThreshold is that of calc::Engine::create()
+        static llvm::Expected<std::unique_ptr<Server>> create(llvm::TargetMachine &TM, unsigned OptLevel,
+                                                              unsigned JITThreshold);
+
+        // Listens on SocketPath, replacing a stale socket, and serves every
+        // connection of the same user on a thread of its own. Only returns
+        // on an error.
+        llvm::Error serve(llvm::StringRef SocketPath);
+    };
+
+    class Client{
+        int FD;
+        explicit Client(int FD) : FD(FD) {}
+        llvm::Expected<std::string> request(llvm::StringRef Request);
+
+    public:
+        // Fails unless the daemon on SocketPath runs as the same user
+        static llvm::Expected<std::unique_ptr<Client>> connect(llvm::StringRef SocketPath);
+        ~Client();
+
+        llvm::Expected<std::vector<int32_t>> evaluate(llvm::StringRef Expr, llvm::StringRef Values,
+                                                      calc_input_format Format);
+        llvm::Expected<std::string> emitObject(llvm::StringRef Expr);
+    };
+} // namespace calcd
+
+#endif
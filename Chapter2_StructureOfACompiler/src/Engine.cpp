@@ -0,0 +1,155 @@
+#include "Engine.h"
+#include "CodeGen.h"
+#include "LLVMCompat.h"
+#include "Parser.h"
+#include "Sema.h"
+#include "Simplify.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+#include <mutex>
+
+using namespace llvm;
+
+namespace calc {
+
+namespace {
+    // Parses, checks and simplifies Expr, returning the messages on an error
+    Expected<AST *> parseExpr(StringRef Expr, ASTContext &ASTCtx){
+        std::string Diags;
+        raw_string_ostream OS(Diags);
+        Lexer Lex(Expr);
+        Parser Parser(Lex, ASTCtx, OS);
+        AST *Tree = Parser.parse();
+        if (!Tree || Parser.hasError() || Sema(OS).semantic(Tree))
+            return createStringError(inconvertibleErrorCode(), OS.str());
+        return Simplifier(ASTCtx).simplify(Tree);
+    }
+} // unnamed namespace
+
+Engine::Engine(std::unique_ptr<CalcJIT> JIT, std::unique_ptr<TargetMachine> TM, unsigned OptLevel,
+               unsigned JITThreshold)
+    : JIT(std::move(JIT)), TM(std::move(TM)), Ctx(std::make_unique<LLVMContext>()), OptLevel(OptLevel),
+      JITThreshold(JITThreshold) {}
+
+// Out of line, as the destructor of CalcJIT is only known here
+Engine::~Engine() = default;
+
+Expected<std::unique_ptr<Engine>> Engine::create(unsigned OptLevel, unsigned JITThreshold){
+    if (OptLevel > 3)
+        return createStringError(inconvertibleErrorCode(), "invalid optimization level %u", OptLevel);
+    compat::enableOpaquePointers();
+    Expected<std::unique_ptr<CalcJIT>> JIT = CalcJIT::create();
+    if (!JIT)
+        return JIT.takeError();
+    Expected<orc::JITTargetMachineBuilder> JTMB = orc::JITTargetMachineBuilder::detectHost();
+    if (!JTMB)
+        return JTMB.takeError();
+    Expected<std::unique_ptr<TargetMachine>> TM = JTMB->createTargetMachine();
+    if (!TM)
+        return TM.takeError();
+    return std::unique_ptr<Engine>(new Engine(std::move(*JIT), std::move(*TM), OptLevel, JITThreshold));
+}
+
+Expected<std::unique_ptr<Handle::Compiled>> Engine::lower(StringRef Expr){
+    ASTContext ASTCtx;
+    Expected<AST *> Tree = parseExpr(Expr, ASTCtx);
+    if (!Tree)
+        return Tree.takeError();
+    auto Result = std::make_unique<Handle::Compiled>();
+    DeclCollector Decls;
+    (*Tree)->accept(Decls);
+    if (Decls.Exprs.size() != 1)
+        return createStringError(inconvertibleErrorCode(), "a handle evaluates a single result");
+    Result->Vars.assign(Decls.Vars.begin(), Decls.Vars.end());
+    Result->Code = Bytecode::compile(*Tree);
+    Result->Owner = this;
+    return Result;
+}
+
+// Called with Mutex held exclusively
+Expected<Handle::FnTy *> Engine::generate(StringRef Expr){
+    std::string Name = ("calc_fn_" + Twine(NumCompiled++)).str();
+    std::unique_ptr<Module> M;
+    {
+        // The context is shared with the modules the JIT has not compiled
+        // yet. The tree is parsed again rather than kept for every handle,
+        // as most expressions are never promoted.
+        auto Lock = Ctx.getLock();
+        ASTContext ASTCtx;
+        Expected<AST *> Tree = parseExpr(Expr, ASTCtx);
+        if (!Tree)
+            return Tree.takeError();
+        M = std::make_unique<Module>("calc.engine", *Ctx.getContext());
+        M->setDataLayout(TM->createDataLayout());
+        M->setTargetTriple(TM->getTargetTriple().getTriple());
+        CodeGen CodeGenerator(TM.get());
+        // The checked function reports a division by zero instead of trapping
+        CodeGenerator.compileResultsFunction(*Tree, *M, Name);
+        CodeGenerator.optimize(*M, OptLevel);
+    }
+    if (Error Err = JIT->addModule(std::move(M), Ctx))
+        return Err;
+    // Looking up the function triggers the machine code generation, which
+    // takes the lock of the context itself
+    return JIT->lookupFunction<Handle::FnTy>(Name);
+}
+
+bool Engine::interpret(const Handle::Compiled &C, const int32_t *Vars, int32_t &Result){
+    // Exactly one evaluation reaches the threshold, so the expression is
+    // generated once; the others keep interpreting until it is done
+    if (C.Evals.fetch_add(1, std::memory_order_relaxed) + 1 == JITThreshold){
+        // The lock is released before the generated code runs, like it
+        // is for every later call
+        Expected<Handle::FnTy *> Fn = [&]{
+            std::unique_lock<std::shared_mutex> Lock(Mutex);
+            return generate(C.Expr);
+        }();
+        if (Fn){
+            C.Fn.store(*Fn, std::memory_order_release);
+            return (*Fn)(Vars, &Result);
+        }
+        // The expression was checked already, so this is a failure of the
+        // JIT itself; the interpreter is still correct
+        consumeError(Fn.takeError());
+    }
+    return C.Code.eval(Vars, Result);
+}
+
+Expected<Handle> Engine::compile(StringRef Expr){
+    {
+        std::shared_lock<std::shared_mutex> Lock(Mutex);
+        auto It = Handles.find(Expr);
+        if (It != Handles.end())
+            return Handle(It->second.get());
+    }
+    std::unique_lock<std::shared_mutex> Lock(Mutex);
+    // Another thread may have compiled it in the meantime
+    auto It = Handles.try_emplace(Expr).first;
+    std::unique_ptr<Handle::Compiled> &Entry = It->second;
+    if (!Entry){
+        Expected<std::unique_ptr<Handle::Compiled>> Compiled = lower(Expr);
+        if (Compiled && JITThreshold == 0){
+            Expected<Handle::FnTy *> Fn = generate(Expr);
+            if (!Fn)
+                Compiled = Fn.takeError();
+            else
+                (*Compiled)->Fn = *Fn;
+        }
+        if (!Compiled){
+            Handles.erase(It);
+            return Compiled.takeError();
+        }
+        Entry = std::move(*Compiled);
+        Entry->Expr = It->getKey();
+    }
+    return Handle(Entry.get());
+}
+
+size_t Engine::size() const {
+    std::shared_lock<std::shared_mutex> Lock(Mutex);
+    return Handles.size();
+}
+
+} // namespace calc
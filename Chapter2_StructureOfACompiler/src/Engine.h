@@ -0,0 +1,132 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+#include "Bytecode.h"
+#include "JIT.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Target/TargetMachine.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+// The embedding API of calc, built as the library libcalc. A service
+// creates one Engine and compiles its expressions into handles, which are
+// evaluated by the interpreter first and by a direct call of the generated
+// code once they are hot:
+//
+//   auto Engine = ExitOnErr(calc::Engine::create());
+//   calc::Handle H = ExitOnErr(Engine->compile("with a,b: a*b+3"));
+//   int32_t Vars[] = {4, 5}, Result;
+//   if (H.eval(Vars, Result)) // Result is 23
+//
+// For C, see LibCalc.h.
+namespace calc {
+    class Engine;
+
+    // A compiled expression. Handles are cheap to copy and stay valid as
+    // long as the Engine which created them. eval() takes no lock, so it
+    // can be called from any number of threads.
+    class Handle{
+    public:
+        using FnTy = bool(const int32_t *Vars, int32_t *Result);
+
+    private:
+        friend class Engine;
+        struct Compiled{
+            mutable std::atomic<FnTy *> Fn{nullptr}; // Set once the expression is promoted to the JIT
+            mutable std::atomic<unsigned> Evals{0}; // Interpreted evaluations so far
+            Bytecode Code;
+            std::vector<std::string> Vars;
+            llvm::StringRef Expr; // The key of the engine's cache
+            Engine *Owner;
+        };
+        const Compiled *C = nullptr;
+
+        explicit Handle(const Compiled *C) : C(C) {}
+
+    public:
+        Handle() = default;
+        explicit operator bool() const { return C; }
+
+        // Vars[I] is the value of the I-th declared variable. Returns false
+        // if the expression divides by zero or INT_MIN by -1, which leaves
+        // Result unchanged.
+        inline bool eval(const int32_t *Vars, int32_t &Result) const;
+
+        // The declared variables, in the order eval() expects them
+        llvm::ArrayRef<std::string> getVars() const { return C->Vars; }
+
+        // The generated function, or nullptr while the expression is interpreted
+        FnTy *getFunction() const { return C->Fn.load(std::memory_order_acquire); }
+
+        // Converts the handle to and from a pointer, e.g. for the C API
+        const void *getOpaqueValue() const { return C; }
+        static Handle getFromOpaqueValue(const void *P) { return Handle(static_cast<const Compiled *>(P)); }
+    };
+
+    // Compiles expressions with a JIT which lives as long as the engine.
+    // All modules are generated in one LLVMContext, so the types and
+    // constants are created only once. The handles are cached by the text
+    // of the expression, so compiling it again only costs a lookup.
+    //
+    // A new expression is only lowered to bytecode (see Bytecode.h), which
+    // takes microseconds instead of the milliseconds of the JIT. Its handle
+    // counts the interpreted evaluations, and the evaluation which reaches
+    // JITThreshold generates machine code, which every later evaluation
+    // calls. Expressions evaluated rarely are never compiled this way.
+    //
+    // All functions may be called concurrently. Cache hits only take a
+    // shared lock; compilations are serialized.
+    class Engine{
+        std::unique_ptr<CalcJIT> JIT;
+        std::unique_ptr<llvm::TargetMachine> TM; // Tunes the optimizer for the host
+        llvm::orc::ThreadSafeContext Ctx;
+        unsigned OptLevel;
+        unsigned JITThreshold;
+        unsigned NumCompiled = 0; // Numbers the generated functions
+        mutable std::shared_mutex Mutex; // Guards Handles and the compilation
+        llvm::StringMap<std::unique_ptr<Handle::Compiled>> Handles;
+
+        Engine(std::unique_ptr<CalcJIT> JIT, std::unique_ptr<llvm::TargetMachine> TM, unsigned OptLevel,
+               unsigned JITThreshold);
+        llvm::Expected<std::unique_ptr<Handle::Compiled>> lower(llvm::StringRef Expr);
+        llvm::Expected<Handle::FnTy *> generate(llvm::StringRef Expr);
+
+        friend class Handle;
+        bool interpret(const Handle::Compiled &C, const int32_t *Vars, int32_t &Result);
+
+    public:
+        // About where the JIT pays off for typical expressions at -O2, see
+        // calc-bench -tier
+        static constexpr unsigned DefaultJITThreshold = 100000;
+
+        // OptLevel is the level of CodeGen::optimize(), 0 to 3. With a
+        // JITThreshold of 0, expressions are compiled to machine code right
+        // away and never interpreted.
+        static llvm::Expected<std::unique_ptr<Engine>> create(unsigned OptLevel = 2,
+                                                              unsigned JITThreshold = DefaultJITThreshold);
+        ~Engine();
+
+        // Returns the handle of Expr, which is compiled on the first call.
+        // Syntax and semantic errors are returned with calc's messages, and
+        // expressions with several results are rejected.
+        llvm::Expected<Handle> compile(llvm::StringRef Expr);
+
+        // The number of distinct expressions compiled so far
+        size_t size() const;
+    };
+
+    bool Handle::eval(const int32_t *Vars, int32_t &Result) const {
+        if (FnTy *Fn = C->Fn.load(std::memory_order_acquire))
+            return Fn(Vars, &Result);
+        return C->Owner->interpret(*C, Vars, Result);
+    }
+} // namespace calc
+
+#endif
@@ -0,0 +1,138 @@
+#include "FileCompiler.h"
+#include "CodeGen.h"
+#include "Parser.h"
+#include "Sema.h"
+#include "Simplify.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/ThreadPool.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+    struct Line{
+        unsigned Number;
+        StringRef Text;
+        std::string Diags; // Messages for this line, printed after all threads are done
+    };
+
+    // The output of one thread
+    struct Chunk{
+        SmallVector<char, 0> Bitcode;
+        bool HasError = false;
+    };
+
+    // Compiles the lines into a module in a fresh context. Modules cannot be
+    // moved between contexts, therefore the result is handed over as bitcode.
+    void compileChunk(MutableArrayRef<Line> Lines, TargetMachine *TM, unsigned OptLevel, bool Fold,
+                      const StringMap<int32_t> &Bindings, Chunk &Result){
+        LLVMContext Ctx;
+        Module M("calc.rules", Ctx);
+        // The optimizer uses the cost model of the target
+        if (TM){
+            M.setDataLayout(TM->createDataLayout());
+            M.setTargetTriple(TM->getTargetTriple().getTriple());
+        }
+        CodeGen CodeGenerator(TM);
+        for (Line &L : Lines){
+            raw_string_ostream OS(L.Diags);
+            ASTContext ASTCtx;
+            Lexer Lex(L.Text);
+            Parser Parser(Lex, ASTCtx, OS);
+            AST *Tree = Parser.parse();
+            if (!Tree || Parser.hasError()){
+                Result.HasError = true;
+                continue;
+            }
+            Sema Semantic(OS);
+            if (Semantic.semantic(Tree)){
+                Result.HasError = true;
+                continue;
+            }
+            // Every line is one function with one result
+            DeclCollector Decls;
+            Tree->accept(Decls);
+            if (Decls.Exprs.size() != 1){
+                OS << "Several results are only supported for a single expression\n";
+                Result.HasError = true;
+                continue;
+            }
+            // Lines after an error are still checked, but not compiled
+            if (Result.HasError)
+                continue;
+            if (Fold || !Bindings.empty()){
+                Simplifier Simplify(ASTCtx, Fold);
+                for (const auto &B : Bindings)
+                    Simplify.bind(B.getKey(), B.getValue());
+                Tree = Simplify.simplify(Tree);
+            }
+            CodeGenerator.compileFunction(Tree, M, ("calc_expr_" + Twine(L.Number)).str());
+        }
+        if (Result.HasError)
+            return;
+        CodeGenerator.optimize(M, OptLevel);
+        raw_svector_ostream OS(Result.Bitcode);
+        WriteBitcodeToFile(M, OS);
+    }
+} // unnamed namespace
+
+std::unique_ptr<Module> FileCompiler::compile(const MemoryBuffer &Buffer, LLVMContext &Ctx, raw_ostream &Diags){
+    std::vector<Line> Lines;
+    for (line_iterator I(Buffer, /*SkipBlanks=*/true, '#'), E; I != E; ++I)
+        Lines.push_back({static_cast<unsigned>(I.line_number()), *I, {}});
+
+    ThreadPoolStrategy Strategy = hardware_concurrency(Threads);
+    unsigned NumChunks = std::max<size_t>(1, std::min<size_t>(Strategy.compute_thread_count(), Lines.size()));
+    std::vector<Chunk> Chunks(NumChunks);
+    // Created here, as the factory need not be thread-safe
+    std::vector<std::unique_ptr<TargetMachine>> TMs(NumChunks);
+    for (std::unique_ptr<TargetMachine> &TM : TMs)
+        TM = CreateTM();
+    {
+        ThreadPool Pool(Strategy);
+        for (unsigned I = 0; I != NumChunks; ++I){
+            size_t Begin = Lines.size() * I / NumChunks;
+            size_t End = Lines.size() * (I + 1) / NumChunks;
+            Pool.async([&, I, Begin, End]{
+                compileChunk(MutableArrayRef<Line>(Lines).slice(Begin, End - Begin), TMs[I].get(), OptLevel, Fold, Bindings,
+                             Chunks[I]);
+            });
+        }
+        Pool.wait();
+    }
+
+    bool HasError = false;
+    for (const Line &L : Lines){
+        SmallVector<StringRef, 4> Messages;
+        StringRef(L.Diags).split(Messages, '\n', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+        for (StringRef Msg : Messages)
+            Diags << Buffer.getBufferIdentifier() << ":" << L.Number << ": " << Msg << "\n";
+    }
+    for (const Chunk &C : Chunks)
+        HasError |= C.HasError;
+    if (HasError)
+        return nullptr;
+
+    auto Result = std::make_unique<Module>("calc.rules", Ctx);
+    if (TargetMachine *TM = TMs.front().get()){
+        Result->setDataLayout(TM->createDataLayout());
+        Result->setTargetTriple(TM->getTargetTriple().getTriple());
+    }
+    Linker L(*Result);
+    for (Chunk &C : Chunks){
+        MemoryBufferRef Ref(StringRef(C.Bitcode.data(), C.Bitcode.size()), "calc.rules");
+        Expected<std::unique_ptr<Module>> M = parseBitcodeFile(Ref, Ctx);
+        if (!M){
+            Diags << toString(M.takeError()) << "\n";
+            return nullptr;
+        }
+        if (L.linkInModule(std::move(*M)))
+            return nullptr;
+    }
+    return Result;
+}
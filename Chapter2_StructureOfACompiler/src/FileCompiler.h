@@ -0,0 +1,51 @@
+#ifndef FILECOMPILER_H
+#define FILECOMPILER_H
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+// Compiles a file with one expression per line into one module. For the
+// expression on line N, the module contains the function
+//   int32_t calc_expr_N(const int32_t *Vars)
+// (see CodeGen::compileFunction()). Blank lines and lines starting with '#'
+// are skipped.
+//
+// The lines are split into contiguous ranges, one per thread. Each thread
+// compiles its range into a module of its own LLVMContext, since a context
+// must not be used by several threads at once. The modules are then linked
+// in line order, so the result does not depend on the number of threads.
+//
+// A target machine must not be used by several threads either, so every
+// thread optimizes with one of its own, created by the given factory.
+class FileCompiler{
+public:
+    using TargetMachineFactory = std::function<std::unique_ptr<llvm::TargetMachine>()>;
+
+private:
+    TargetMachineFactory CreateTM;
+    unsigned Threads; // 0 selects one thread per CPU
+    unsigned OptLevel;
+    bool Fold; // Run the Simplifier on every line
+    llvm::StringMap<int32_t> Bindings;
+public:
+    FileCompiler(TargetMachineFactory CreateTM, unsigned Threads, unsigned OptLevel, bool Fold)
+        : CreateTM(std::move(CreateTM)), Threads(Threads), OptLevel(OptLevel), Fold(Fold) {}
+
+    // Binds the variable Name to Value in every line declaring it (see
+    // Simplifier::bind())
+    void bind(llvm::StringRef Name, int32_t Value) { Bindings[Name] = Value; }
+
+    // Returns nullptr if any line has an error. The messages are written to
+    // Diags in line order, each prefixed with the file name and line number.
+    // The module has the data layout and triple of the target machines.
+    std::unique_ptr<llvm::Module> compile(const llvm::MemoryBuffer &Buffer, llvm::LLVMContext &Ctx,
+                                          llvm::raw_ostream &Diags);
+};
+
+#endif
@@ -0,0 +1,55 @@
+#include "JIT.h"
+#include "LLVMCompat.h"
+#include "RTCalc.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/Support/TargetSelect.h"
+
+using namespace llvm;
+using namespace llvm::orc;
+
+namespace {
+    // Maps the runtime functions called by the generated code to the
+    // implementation in RTCalc.c, which is part of the calc binary.
+    SymbolMap getRuntimeSymbols(LLJIT &J){
+        SymbolMap Symbols;
+        auto Define = [&](StringRef Name, void *Addr){
+            Symbols[J.mangleAndIntern(Name)] = compat::makeSymbol(Addr, JITSymbolFlags::Exported);
+        };
+        Define("calc_read", reinterpret_cast<void *>(&calc_read));
+        Define("calc_write", reinterpret_cast<void *>(&calc_write));
+        Define("calc_div_error", reinterpret_cast<void *>(&calc_div_error));
+        return Symbols;
+    }
+} // unnamed namespace
+
+Expected<std::unique_ptr<CalcJIT>> CalcJIT::create(){
+    // The JIT generates code for the machine calc is running on
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+
+    auto J = LLJITBuilder().create();
+    if (!J)
+        return J.takeError();
+
+    if (Error Err = (*J)->getMainJITDylib().define(absoluteSymbols(getRuntimeSymbols(**J))))
+        return Err;
+
+    return std::unique_ptr<CalcJIT>(new CalcJIT(std::move(*J)));
+}
+
+Error CalcJIT::addModule(std::unique_ptr<Module> M, std::unique_ptr<LLVMContext> Ctx){
+    return addModule(std::move(M), ThreadSafeContext(std::move(Ctx)));
+}
+
+Error CalcJIT::addModule(std::unique_ptr<Module> M, ThreadSafeContext Ctx){
+    // Generated modules carry no data layout, so adopt the one of the JIT
+    M->setDataLayout(JIT->getDataLayout());
+    return JIT->addIRModule(ThreadSafeModule(std::move(M), std::move(Ctx)));
+}
+
+Expected<void *> CalcJIT::lookup(StringRef Name){
+    auto Sym = JIT->lookup(Name);
+    if (!Sym)
+        return Sym.takeError();
+    return compat::toPointer(*Sym);
+}
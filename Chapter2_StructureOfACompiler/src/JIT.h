@@ -0,0 +1,40 @@
+#ifndef JIT_H
+#define JIT_H
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+#include <memory>
+
+// Executes the modules produced by CodeGen in the calc process itself.
+// The runtime functions calc_read() and calc_write() are resolved to the
+// copies linked into calc, so no llc, linker or new process is needed.
+class CalcJIT{
+    std::unique_ptr<llvm::orc::LLJIT> JIT;
+
+    explicit CalcJIT(std::unique_ptr<llvm::orc::LLJIT> JIT) : JIT(std::move(JIT)){}
+
+public:
+    static llvm::Expected<std::unique_ptr<CalcJIT>> create();
+
+    // The JIT takes ownership of the module together with the context it lives in.
+    llvm::Error addModule(std::unique_ptr<llvm::Module> M, std::unique_ptr<llvm::LLVMContext> Ctx);
+
+    // Adds a module living in a context which is shared with other modules.
+    // The JIT locks the context while it compiles the module.
+    llvm::Error addModule(std::unique_ptr<llvm::Module> M, llvm::orc::ThreadSafeContext Ctx);
+
+    // Returns the address of a function defined in one of the added modules.
+    llvm::Expected<void *> lookup(llvm::StringRef Name);
+
+    template<typename FnTy>
+    llvm::Expected<FnTy *> lookupFunction(llvm::StringRef Name){
+        llvm::Expected<void *> Addr = lookup(Name);
+        if (!Addr)
+            return Addr.takeError();
+        return reinterpret_cast<FnTy *>(*Addr);
+    }
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef LLVMCOMPAT_H
+#define LLVMCOMPAT_H
+// calc is written against LLVM 17. It still builds with LLVM 14, as packaged
+// by older distributions; the interfaces which changed in between are
+// wrapped here, so the rest of the code uses the LLVM 17 API only.
+#include "llvm/Config/llvm-config.h"
+#include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/StandardInstrumentations.h"
+#include "llvm/Support/CommandLine.h"
+#if LLVM_VERSION_MAJOR >= 17
+#include "llvm/ExecutionEngine/Orc/Shared/ExecutorSymbolDef.h"
+#include "llvm/TargetParser/Host.h"
+#else
+#include "llvm/Support/Host.h"
+#endif
+
+namespace compat {
+    // Pointers are opaque ("ptr") since LLVM 15. LLVM 14 creates contexts
+    // in this mode with -opaque-pointers, so this has to be called before
+    // the first LLVMContext is created, and after the command line is parsed.
+    inline void enableOpaquePointers(){
+#if LLVM_VERSION_MAJOR < 15
+        llvm::StringMap<llvm::cl::Option *> &Options = llvm::cl::getRegisteredOptions();
+        auto It = Options.find("opaque-pointers");
+        if (It != Options.end())
+            static_cast<llvm::cl::opt<bool> *>(It->second)->setValue(true);
+#endif
+    }
+
+    // Before LLVM 17, the instrumentations neither took the context nor
+    // registered with the module analysis manager
+    class StandardInstrumentations : public llvm::StandardInstrumentations{
+    public:
+#if LLVM_VERSION_MAJOR >= 17
+        StandardInstrumentations(llvm::LLVMContext &Ctx, bool DebugLogging)
+            : llvm::StandardInstrumentations(Ctx, DebugLogging) {}
+#else
+        StandardInstrumentations(llvm::LLVMContext &, bool DebugLogging)
+            : llvm::StandardInstrumentations(DebugLogging) {}
+#endif
+
+        void registerCallbacks(llvm::PassInstrumentationCallbacks &PIC, llvm::ModuleAnalysisManager &MAM,
+                               llvm::FunctionAnalysisManager &FAM){
+#if LLVM_VERSION_MAJOR >= 17
+            (void)FAM;
+            llvm::StandardInstrumentations::registerCallbacks(PIC, &MAM);
+#else
+            (void)MAM;
+            llvm::StandardInstrumentations::registerCallbacks(PIC, &FAM);
+#endif
+        }
+    };
+
+    // The JIT describes symbols by ExecutorSymbolDef and ExecutorAddr since
+    // LLVM 17, and by JITEvaluatedSymbol before
+#if LLVM_VERSION_MAJOR >= 17
+    inline llvm::orc::ExecutorSymbolDef makeSymbol(void *Addr, llvm::JITSymbolFlags Flags){
+        return llvm::orc::ExecutorSymbolDef(llvm::orc::ExecutorAddr::fromPtr(Addr), Flags);
+    }
+
+    inline void *toPointer(llvm::orc::ExecutorAddr Addr){
+        return Addr.toPtr<void *>();
+    }
+#else
+    inline llvm::JITEvaluatedSymbol makeSymbol(void *Addr, llvm::JITSymbolFlags Flags){
+        return llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(Addr), Flags);
+    }
+
+    inline void *toPointer(const llvm::JITEvaluatedSymbol &Sym){
+        return llvm::jitTargetAddressToPointer<void *>(Sym.getAddress());
+    }
+#endif
+} // namespace compat
+
+#endif
@@ -20,17 +20,17 @@ namespace charinfo
 
 void Lexer::next(Token &token){
     // Ignore white spaces
-    while (*BufferPtr && charinfo::isWhitespace(*BufferPtr)){
+    while (BufferPtr != BufferEnd && charinfo::isWhitespace(*BufferPtr)){
         ++BufferPtr;
     }
     // Make sure that there are still characters left to process
-    if (!*BufferPtr){
+    if (BufferPtr == BufferEnd){
         token.Kind = Token::eoi;
         return;
     }
     if (charinfo::isLetter(*BufferPtr)){
         const char *end = BufferPtr + 1;
-        while (charinfo::isLetter(*end))
+        while (end != BufferEnd && charinfo::isLetter(*end))
         {
             ++end;
         }
@@ -40,7 +40,7 @@ void Lexer::next(Token &token){
         return;
     } else if (charinfo::isDigit(*BufferPtr)){
         const char *end = BufferPtr + 1;
-        while (charinfo::isDigit(*end))
+        while (end != BufferEnd && charinfo::isDigit(*end))
         {
             ++end;
         }
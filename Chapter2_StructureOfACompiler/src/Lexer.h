@@ -46,10 +46,12 @@ public:
 class Lexer{
     const char *BufferStart;
     const char *BufferPtr;
+    const char *BufferEnd; // The buffer needs no terminating 0, e.g. a line of a file
     public:
     Lexer(const llvm::StringRef &Buffer){
         BufferStart = Buffer.begin();
         BufferPtr = BufferStart;
+        BufferEnd = Buffer.end();
     }
     void next(Token &token);
     private:
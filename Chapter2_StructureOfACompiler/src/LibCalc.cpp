@@ -0,0 +1,59 @@
+#include "LibCalc.h"
+#include "Engine.h"
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+using namespace llvm;
+
+struct calc_engine{
+    std::unique_ptr<calc::Engine> Engine;
+};
+
+// A calc_handle is the opaque value of a calc::Handle, i.e. the compiled
+// expression owned by the engine
+static calc::Handle unwrap(const calc_handle *H){
+    return calc::Handle::getFromOpaqueValue(H);
+}
+
+static char *takeMessage(Error Err){
+    return strdup(toString(std::move(Err)).c_str());
+}
+
+calc_engine *calc_engine_create(unsigned opt_level, char **error){
+    Expected<std::unique_ptr<calc::Engine>> Engine = calc::Engine::create(opt_level);
+    if (!Engine){
+        *error = takeMessage(Engine.takeError());
+        return nullptr;
+    }
+    return new calc_engine{std::move(*Engine)};
+}
+
+void calc_engine_dispose(calc_engine *engine){
+    delete engine;
+}
+
+const calc_handle *calc_compile(calc_engine *engine, const char *expr, char **error){
+    Expected<calc::Handle> H = engine->Engine->compile(expr);
+    if (!H){
+        *error = takeMessage(H.takeError());
+        return nullptr;
+    }
+    return static_cast<const calc_handle *>(H->getOpaqueValue());
+}
+
+int calc_eval(const calc_handle *handle, const int32_t *vars, int32_t *result){
+    return unwrap(handle).eval(vars, *result) ? 0 : -1;
+}
+
+size_t calc_num_vars(const calc_handle *handle){
+    return unwrap(handle).getVars().size();
+}
+
+const char *calc_var_name(const calc_handle *handle, size_t i){
+    return unwrap(handle).getVars()[i].c_str();
+}
+
+void calc_dispose_message(char *message){
+    std::free(message);
+}
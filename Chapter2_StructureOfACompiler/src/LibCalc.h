@@ -0,0 +1,50 @@
+#ifndef LIBCALC_H
+#define LIBCALC_H
+/* The C interface of libcalc, a thin layer over calc::Engine (see Engine.h).
+ *
+ *   char *error;
+ *   calc_engine *engine = calc_engine_create(2, &error);
+ *   const calc_handle *h = calc_compile(engine, "with a,b: a*b+3", &error);
+ *   int32_t vars[] = {4, 5}, result;
+ *   if (calc_eval(h, vars, &result) == 0) ... result is 23
+ *   calc_engine_dispose(engine);
+ *
+ * On failure, the functions returning a pointer return NULL and store a
+ * message in *error, which must be released with calc_dispose_message().
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct calc_engine calc_engine;
+typedef struct calc_handle calc_handle;
+
+/* Creates an engine optimizing with opt_level 0 to 3. */
+calc_engine *calc_engine_create(unsigned opt_level, char **error);
+
+/* Releases the engine together with all its handles. */
+void calc_engine_dispose(calc_engine *engine);
+
+/* Compiles expr, or returns the handle of an earlier compilation of the same
+ * text. May be called from several threads at once. */
+const calc_handle *calc_compile(calc_engine *engine, const char *expr, char **error);
+
+/* Evaluates the expression into *result. vars[i] is the value of the i-th
+ * declared variable. Returns 0 on success and -1 if the expression divides
+ * by zero or INT32_MIN by -1, which leaves *result unchanged. */
+int calc_eval(const calc_handle *handle, const int32_t *vars, int32_t *result);
+
+/* The number and the names of the declared variables */
+size_t calc_num_vars(const calc_handle *handle);
+const char *calc_var_name(const calc_handle *handle, size_t i);
+
+void calc_dispose_message(char *message);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,7 +2,7 @@
 
 /*
  * The grammar for the language is:
- *   calc : ("with" ident ("," ident)* ":")? expr ;
+ *   calc : ("with" ident ("," ident)* ":")? expr ("," expr)* ;
  *   expr : term (( "+" | "-" ) term)* ;
  *   term : factor (( "*" | "/") factor)* ;
  *   factor : ident | number | "(" expr ")" ;
@@ -16,10 +16,11 @@ AST *Parser::parse(){
 }
 
 // Implements 
-//    calc : ("with" ident ("," ident)* ":")? expr ;
+//    calc : ("with" ident ("," ident)* ":")? expr ("," expr)* ;
 AST *Parser::parseCalc(){
-    Expr *E;
+    llvm::SmallVector<Expr *, 4> Exprs;
     llvm::SmallVector<llvm::StringRef, 8> Vars;
+    llvm::SmallVector<unsigned, 8> IDs;
 
     // Conditional ("with" ident ("," ident)* ":")? 
     if (Tok.is(Token::KW_with)){
@@ -29,6 +30,7 @@ AST *Parser::parseCalc(){
             goto _error;
         }
         Vars.push_back(Tok.getText());
+        IDs.push_back(Ctx.getIdentifierID(Tok.getText()));
         advance();
         while (Tok.is(Token::comma)){
             advance();
@@ -36,6 +38,7 @@ AST *Parser::parseCalc(){
                 goto _error;
             }
             Vars.push_back(Tok.getText());
+            IDs.push_back(Ctx.getIdentifierID(Tok.getText()));
             advance();
         }
         
@@ -44,12 +47,17 @@ AST *Parser::parseCalc(){
         }
     }
 
-    // Expression is non-conditional, i.e. must always be there
-    E = parseExpr();
-    if (Vars.empty()) {
-        return E;
+    // Expression is non-conditional, i.e. must always be there. Further
+    // results, separated by commas, are computed from the same variables.
+    do {
+        if (!Exprs.empty())
+            advance();
+        Exprs.push_back(Strat == OperatorPrecedence ? parseExprIterative() : parseExpr());
+    } while (Tok.is(Token::comma));
+    if (Vars.empty() && Exprs.size() == 1) {
+        return Exprs.front();
     } else {
-        return new WithDecl(Vars, E);
+        return new (Ctx) WithDecl(Ctx.copy<llvm::StringRef>(Vars), Ctx.copy<unsigned>(IDs), Ctx.copy<Expr *>(Exprs));
     }
 
     _error:
@@ -71,7 +79,7 @@ Expr *Parser::parseExpr(){
         BinaryOp::Operator Op = Tok.is(Token::plus) ? BinaryOp::Plus : BinaryOp::Minus;
         advance();
         Expr *Right = parseTerm();
-        Left = new BinaryOp(Op, Left, Right);
+        Left = new (Ctx) BinaryOp(Op, Left, Right);
     }
     return Left;
     
@@ -85,7 +93,7 @@ Expr *Parser::parseTerm(){
         BinaryOp::Operator Op = Tok.is(Token::star) ? BinaryOp::Mul : BinaryOp::Div;
         advance();
         Expr *Right = parseFactor();
-        Left = new BinaryOp(Op, Left, Right);
+        Left = new (Ctx) BinaryOp(Op, Left, Right);
     }
     return Left;
 }
@@ -97,11 +105,11 @@ Expr *Parser::parseFactor(){
     Expr *Res = nullptr;
     switch (Tok.getKind()){
     case Token::number:
-        Res = new Factor(Factor::Number, Tok.getText());
+        Res = new (Ctx) Factor(Factor::Number, Tok.getText());
         advance();
         break;
     case Token::ident:
-        Res = new Factor(Factor::Ident, Tok.getText());
+        Res = new (Ctx) Factor(Factor::Ident, Tok.getText(), Ctx.getIdentifierID(Tok.getText()));
         advance();
         break;
     case Token::l_paren:
@@ -111,9 +119,87 @@ Expr *Parser::parseFactor(){
 
     default:
         if(!Res) error();
-        while(!Tok.isOneOf(Token::r_paren, Token::star, Token::plus, Token::minus, Token::slash, Token::eoi))
+        while(!Tok.isOneOf(Token::r_paren, Token::star, Token::plus, Token::minus, Token::slash, Token::comma, Token::eoi))
             advance();
 
     }
     return Res;
-}
\ No newline at end of file
+}
+
+// Implements expr, term and factor like the functions above, but without
+// recursion. Operands and pending operators are kept on explicit stacks:
+// an operator is pushed after all operators of the same or a higher
+// precedence on the stack have been applied (reduced), which yields the
+// same left-associative tree as the recursive functions. An opening
+// parenthesis is pushed as a marker which stops the reduction until the
+// matching closing parenthesis is seen. Every token is pushed and popped
+// at most once, so the time is linear in the length of the input.
+Expr *Parser::parseExprIterative(){
+    // A pending operator, or an opening parenthesis with precedence 0
+    struct PendingOp{
+        BinaryOp::Operator Op;
+        unsigned Prec;
+    };
+    llvm::SmallVector<PendingOp, 32> Ops;
+    llvm::SmallVector<Expr *, 32> Operands;
+
+    auto reduce = [&]{
+        Expr *Right = Operands.pop_back_val();
+        Expr *&Left = Operands.back();
+        Left = new (Ctx) BinaryOp(Ops.pop_back_val().Op, Left, Right);
+    };
+
+    for (;;){
+        // An operand, possibly preceded by opening parentheses
+        while (Tok.is(Token::l_paren)){
+            Ops.push_back({BinaryOp::Plus, 0});
+            advance();
+        }
+        if (!Tok.isOneOf(Token::number, Token::ident))
+            goto _error;
+        if (Tok.is(Token::number))
+            Operands.push_back(new (Ctx) Factor(Factor::Number, Tok.getText()));
+        else
+            Operands.push_back(new (Ctx) Factor(Factor::Ident, Tok.getText(), Ctx.getIdentifierID(Tok.getText())));
+        advance();
+
+        // Closing parentheses, each ending the subexpression of its marker
+        while (Tok.is(Token::r_paren)){
+            while (!Ops.empty() && Ops.back().Prec)
+                reduce();
+            // Unbalanced, which parse() reports as it expects the end here
+            if (Ops.empty())
+                break;
+            Ops.pop_back();
+            advance();
+        }
+
+        PendingOp Next;
+        switch (Tok.getKind()){
+        case Token::plus: Next = {BinaryOp::Plus, 1}; break;
+        case Token::minus: Next = {BinaryOp::Minus, 1}; break;
+        case Token::star: Next = {BinaryOp::Mul, 2}; break;
+        case Token::slash: Next = {BinaryOp::Div, 2}; break;
+        default: goto _done;
+        }
+        while (!Ops.empty() && Ops.back().Prec >= Next.Prec)
+            reduce();
+        Ops.push_back(Next);
+        advance();
+    }
+
+    _done:
+    while (!Ops.empty()){
+        if (!Ops.back().Prec)
+            goto _error; // Missing closing parenthesis
+        reduce();
+    }
+    return Operands.pop_back_val();
+
+    _error:
+    error();
+    while (!Tok.is(Token::eoi)){
+        advance();
+    }
+    return nullptr;
+}
@@ -8,12 +8,24 @@
 #include "llvm/Support/raw_ostream.h"
 
 class Parser{
+    public:
+    // How expressions are parsed. Recursive descent follows the grammar
+    // directly, but needs stack frames for every nesting level, so deeply
+    // nested input can overflow the stack. Operator precedence parsing keeps
+    // its state in heap-allocated stacks and handles any nesting depth; the
+    // later phases still recurse over the depth of the resulting tree.
+    enum Strategy { RecursiveDescent, OperatorPrecedence };
+
+    private:
     Lexer &Lex;
+    ASTContext &Ctx; // Owns the created nodes
+    llvm::raw_ostream &Diags; // Receives the error messages
     Token Tok;
     bool HasError;
+    Strategy Strat = RecursiveDescent;
 
     void error(){
-        llvm::errs() << "Unexpected: " << Tok.getText() << "\n";
+        Diags << "Unexpected: " << Tok.getText() << "\n";
         HasError = true;
     }
 
@@ -40,13 +52,16 @@ class Parser{
     Expr *parseExpr();
     Expr *parseTerm();
     Expr *parseFactor();
+    Expr *parseExprIterative();
 
     public:
-    explicit Parser(Lexer &Lex) : Lex(Lex), HasError(false){
+    Parser(Lexer &Lex, ASTContext &Ctx, llvm::raw_ostream &Diags = llvm::errs())
+        : Lex(Lex), Ctx(Ctx), Diags(Diags), HasError(false){
         advance();
     }
 
     bool hasError() { return HasError; }
+    void setStrategy(Strategy S) { Strat = S; }
 
     AST *parse();
 };
@@ -1,10 +1,175 @@
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "RTCalc.h"
+
+/* Batch mode, see RTCalc.h. The input is memory-mapped, so reading a value
+ * is a scan over the mapping without any copying or stdio calls, and the
+ * results are collected in a large buffer which is written with one system
+ * call when it is full. */
+#define CALC_OUT_SIZE (1 << 20)
+
+static int calc_batch = -1; /* -1 until CALC_INPUT has been checked */
+static const char *calc_in_begin, *calc_in_ptr, *calc_in_end;
+static enum calc_input_format calc_in_format;
+static char calc_out[CALC_OUT_SIZE];
+static size_t calc_out_len;
+
+static int calc_map(const char *path, const char **data, size_t *size){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return -1;
+    struct stat st;
+    if(fstat(fd, &st)){
+        close(fd);
+        return -1;
+    }
+    *data = NULL;
+    *size = (size_t)st.st_size;
+    if(*size){ /* mmap() rejects an empty mapping */
+        void *p = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p == MAP_FAILED){
+            close(fd);
+            return -1;
+        }
+        madvise(p, *size, MADV_SEQUENTIAL);
+        *data = p;
+    }
+    close(fd);
+    return 0;
+}
+
+/* Parses the next value at or after *p into *val. The digit test is a
+ * single unsigned comparison, and the number is accumulated in unsigned
+ * arithmetic, so out-of-range values wrap instead of being undefined.
+ * Returns 0 if there is no further value. */
+static int calc_parse_csv(const char **p, const char *end, int32_t *val){
+    const char *s = *p;
+    for(;; ++s){
+        if(s == end)
+            return 0;
+        if((unsigned)(*s - '0') < 10)
+            break;
+        if(*s == '-' && s + 1 != end && (unsigned)(s[1] - '0') < 10)
+            break;
+    }
+    int neg = *s == '-';
+    s += neg;
+    uint32_t v = 0;
+    unsigned d;
+    while(s != end && (d = (unsigned)(*s - '0')) < 10){
+        v = v * 10 + d;
+        ++s;
+    }
+    *val = (int32_t)(neg ? 0u - v : v);
+    *p = s;
+    return 1;
+}
+
+static int calc_next_value(const char **p, int32_t *val){
+    if(calc_in_format == CALC_INPUT_BINARY){
+        if(calc_in_end - *p < (ptrdiff_t)sizeof(*val))
+            return 0;
+        memcpy(val, *p, sizeof(*val));
+        *p += sizeof(*val);
+        return 1;
+    }
+    return calc_parse_csv(p, calc_in_end, val);
+}
+
+static void calc_put(int32_t v){
+    if(calc_out_len > CALC_OUT_SIZE - 16)
+        calc_flush();
+    char tmp[12], *end = tmp + sizeof(tmp), *p = end;
+    uint32_t u = v < 0 ? 0u - (uint32_t)v : (uint32_t)v;
+    do {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while(u);
+    if(v < 0)
+        *--p = '-';
+    memcpy(calc_out + calc_out_len, p, (size_t)(end - p));
+    calc_out_len += (size_t)(end - p);
+    calc_out[calc_out_len++] = '\n';
+}
+
+void calc_flush(void){
+    fflush(stdout); /* Keep the order with output written through stdio */
+    size_t off = 0;
+    while(off < calc_out_len){
+        ssize_t w = write(STDOUT_FILENO, calc_out + off, calc_out_len - off);
+        if(w < 0){
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+        off += (size_t)w;
+    }
+    calc_out_len = 0;
+}
+
+int calc_open_input(const char *path, enum calc_input_format format){
+    const char *data;
+    size_t size;
+    if(calc_map(path, &data, &size))
+        return -1;
+    if(calc_in_begin)
+        munmap((void *)calc_in_begin, (size_t)(calc_in_end - calc_in_begin));
+    calc_in_begin = calc_in_ptr = data;
+    calc_in_end = data + size;
+    calc_in_format = format;
+    if(calc_batch != 1)
+        atexit(calc_flush);
+    calc_batch = 1;
+    return 0;
+}
+
+int calc_input_done(void){
+    const char *p = calc_in_ptr;
+    int32_t val;
+    return !calc_next_value(&p, &val);
+}
+
+static int calc_batch_mode(void){
+    if(calc_batch < 0){
+        calc_batch = 0;
+        const char *path = getenv("CALC_INPUT");
+        if(path){
+            const char *format = getenv("CALC_INPUT_FORMAT");
+            if(calc_open_input(path, format && !strcmp(format, "bin") ? CALC_INPUT_BINARY : CALC_INPUT_CSV)){
+                fprintf(stderr, "Cannot read %s\n", path);
+                exit(1);
+            }
+        }
+    }
+    return calc_batch;
+}
+
 void calc_write(int v){
+    if(calc_batch_mode()){
+        calc_put(v);
+        return;
+    }
     printf("The result is: %d\n", v);
 }
 
 int calc_read(char *s){
+    if(calc_batch_mode()){
+        int32_t val;
+        if(!calc_next_value(&calc_in_ptr, &val)){
+            calc_flush();
+            fprintf(stderr, "No value for %s in the input\n", s);
+            exit(1);
+        }
+        return val;
+    }
     char buf[64];
     int val;
     printf("Enter a value for %s: ", s);
@@ -14,4 +179,216 @@ int calc_read(char *s){
         exit(1);
     }
     return val;
-}
\ No newline at end of file
+}
+
+void calc_div_error(void){
+    calc_flush();
+    fprintf(stderr, "calc: division by zero or of INT_MIN by -1\n");
+}
+
+/* Parallel batch evaluation.
+ * The rows are split into chunks of CALC_CHUNK_ROWS rows. Every worker owns a
+ * contiguous range of chunk indices, packed as (begin << 32 | end) into one
+ * atomic word. The owner takes chunks from the front of its range. A worker
+ * whose range is empty steals the back half of another worker's range. Both
+ * are a single compare-and-swap on the victim's word, so no locks are taken.
+ * A range value can recur, e.g. after a worker steals back chunks taken from
+ * it, so the word may change and change back between the load and the
+ * compare-and-swap. That ABA is harmless: the word alone describes the
+ * chunks the worker still owns, none of which have been handed out, so a
+ * new value computed from an identical old one is as correct as without
+ * the intermediate changes.
+ */
+#define CALC_CHUNK_ROWS 16384
+
+struct calc_worker {
+    _Alignas(64) _Atomic uint64_t range; /* Own cache line, avoids false sharing */
+    pthread_t thread;
+    struct calc_batch *batch;
+};
+
+struct calc_batch {
+    calc_kernel_fn kernel;
+    const int32_t *const *cols;
+    size_t ncols;
+    int32_t *out;
+    size_t n;
+    unsigned nworkers;
+    struct calc_worker *workers;
+    _Atomic size_t bad_row; /* The first failing row found so far, or n */
+};
+
+static uint64_t calc_pack(uint32_t begin, uint32_t end){
+    return ((uint64_t)begin << 32) | end;
+}
+
+/* Takes the first chunk of the worker's own range. */
+static int calc_pop(struct calc_worker *w, uint32_t *chunk){
+    uint64_t r = atomic_load(&w->range);
+    for(;;){
+        uint32_t begin = r >> 32, end = (uint32_t)r;
+        if(begin >= end)
+            return 0;
+        if(atomic_compare_exchange_weak(&w->range, &r, calc_pack(begin + 1, end))){
+            *chunk = begin;
+            return 1;
+        }
+    }
+}
+
+/* Moves the back half of the victim's range into the thief's range. */
+static int calc_steal(struct calc_worker *thief, struct calc_worker *victim){
+    uint64_t r = atomic_load(&victim->range);
+    for(;;){
+        uint32_t begin = r >> 32, end = (uint32_t)r;
+        if(begin >= end)
+            return 0;
+        uint32_t half = (end - begin + 1) / 2;
+        if(atomic_compare_exchange_weak(&victim->range, &r, calc_pack(begin, end - half))){
+            /* The thief's range is empty, so nobody else modifies it */
+            atomic_store(&thief->range, calc_pack(end - half, end));
+            return 1;
+        }
+    }
+}
+
+/* Lowers *row to r. Rows are found in any order, the first one is kept. */
+static void calc_lower(_Atomic size_t *row, size_t r){
+    size_t cur = atomic_load(row);
+    while(r < cur && !atomic_compare_exchange_weak(row, &cur, r))
+        ;
+}
+
+static void *calc_worker_main(void *arg){
+    struct calc_worker *self = arg;
+    struct calc_batch *b = self->batch;
+    unsigned id = (unsigned)(self - b->workers);
+    /* Column pointers advanced to the start of the current chunk */
+    const int32_t **cols = malloc((b->ncols ? b->ncols : 1) * sizeof(*cols));
+    if(!cols)
+        abort();
+    for(;;){
+        uint32_t chunk;
+        while(calc_pop(self, &chunk)){
+            size_t start = (size_t)chunk * CALC_CHUNK_ROWS;
+            /* After a failing row, only the chunks before it still matter */
+            if(start >= atomic_load_explicit(&b->bad_row, memory_order_relaxed))
+                continue;
+            size_t len = b->n - start < CALC_CHUNK_ROWS ? b->n - start : CALC_CHUNK_ROWS;
+            for(size_t i = 0; i < b->ncols; ++i)
+                cols[i] = b->cols[i] + start;
+            size_t done = b->kernel(cols, b->out + start, len);
+            if(done < len)
+                calc_lower(&b->bad_row, start + done);
+        }
+        /* Look for work at the other workers, starting with the next one */
+        unsigned v;
+        for(v = 1; v < b->nworkers; ++v)
+            if(calc_steal(self, &b->workers[(id + v) % b->nworkers]))
+                break;
+        if(v == b->nworkers)
+            break;
+    }
+    free(cols);
+    return NULL;
+}
+
+int calc_run_parallel(calc_kernel_fn kernel, const int32_t *const *cols, size_t ncols,
+                      int32_t *out, size_t n, unsigned nthreads, size_t *bad_row){
+    size_t nchunks = (n + CALC_CHUNK_ROWS - 1) / CALC_CHUNK_ROWS;
+    if(nchunks > UINT32_MAX)
+        return -1;
+    if(nthreads == 0){
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = cpus > 0 ? (unsigned)cpus : 1;
+    }
+    if(nthreads > nchunks)
+        nthreads = nchunks ? (unsigned)nchunks : 1;
+
+    struct calc_worker *workers = aligned_alloc(64, nthreads * sizeof(*workers));
+    if(!workers)
+        return -1;
+    struct calc_batch batch = { kernel, cols, ncols, out, n, nthreads, workers, n };
+    /* Start with an even split, stealing balances the rest */
+    for(unsigned i = 0; i < nthreads; ++i){
+        uint32_t begin = (uint32_t)(nchunks * i / nthreads);
+        uint32_t end = (uint32_t)(nchunks * (i + 1) / nthreads);
+        atomic_init(&workers[i].range, calc_pack(begin, end));
+        workers[i].batch = &batch;
+    }
+
+    /* The calling thread acts as worker 0. If a thread cannot be created,
+     * its chunks are stolen by the running workers. */
+    unsigned started = 1;
+    for(; started < nthreads; ++started)
+        if(pthread_create(&workers[started].thread, NULL, calc_worker_main, &workers[started]))
+            break;
+    calc_worker_main(&workers[0]);
+    for(unsigned i = 1; i < started; ++i)
+        pthread_join(workers[i].thread, NULL);
+    free(workers);
+    if(batch.bad_row < n){
+        *bad_row = batch.bad_row;
+        return 1;
+    }
+    return 0;
+}
+
+long calc_eval_file(calc_kernel_fn kernel, size_t ncols, const char *path,
+                    enum calc_input_format format, unsigned nthreads, size_t *bad_row){
+    const char *data;
+    size_t size;
+    if(!ncols || calc_map(path, &data, &size))
+        return -1;
+    /* A CSV value takes at least two characters, a digit and a separator */
+    size_t maxrows = (format == CALC_INPUT_BINARY ? size / sizeof(int32_t) : size / 2 + 1) / ncols;
+    /* The columns and the results share one allocation. Pages beyond the
+     * actual number of rows are never touched, so they cost no memory. */
+    int32_t *mem = malloc((ncols + 1) * (maxrows ? maxrows : 1) * sizeof(int32_t));
+    const int32_t **cols = malloc(ncols * sizeof(*cols));
+    if(!mem || !cols){
+        free(mem);
+        free(cols);
+        if(data)
+            munmap((void *)data, size);
+        return -1;
+    }
+
+    /* Distribute the row-major values into the columns */
+    const char *p = data, *end = data + size;
+    size_t rows = 0, col = 0;
+    int32_t val;
+    while(rows < maxrows){ /* Values after the last complete row are ignored */
+        if(format == CALC_INPUT_BINARY){
+            if(end - p < (ptrdiff_t)sizeof(val))
+                break;
+            memcpy(&val, p, sizeof(val));
+            p += sizeof(val);
+        } else if(!calc_parse_csv(&p, end, &val)){
+            break;
+        }
+        mem[col * maxrows + rows] = val;
+        if(++col == ncols){
+            col = 0;
+            ++rows;
+        }
+    }
+    if(data)
+        munmap((void *)data, size);
+
+    for(size_t i = 0; i < ncols; ++i)
+        cols[i] = mem + i * maxrows;
+    int32_t *out = mem + ncols * maxrows;
+    long result = -1;
+    int status = calc_run_parallel(kernel, cols, ncols, out, rows, nthreads, bad_row);
+    if(status >= 0){
+        size_t done = status ? *bad_row : rows;
+        for(size_t r = 0; r < done; ++r)
+            calc_put(out[r]);
+        calc_flush();
+        result = status ? -2 : (long)rows;
+    }
+    free(cols);
+    free(mem);
+    return result;
+}
@@ -0,0 +1,72 @@
+#ifndef RTCALC_H
+#define RTCALC_H
+/* The runtime functions called by the code generated by calc.
+ * The header is shared between the C runtime and the C++ compiler,
+ * which links the runtime in when it executes expressions in-process.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void calc_write(int v);
+int calc_read(char *s);
+
+/* Called by main() instead of a division by zero or of INT_MIN by -1,
+ * which would trap. Writes the buffered results and reports the error;
+ * main() then returns 1. */
+void calc_div_error(void);
+
+/* Signature of the calc_kernel() function generated with -kernel. It returns
+ * n, or the first row which would divide by zero or INT_MIN by -1. */
+typedef size_t (*calc_kernel_fn)(const int32_t *const *cols, int32_t *out, size_t n);
+
+/* Batch mode: instead of prompting, calc_read() returns the next value of an
+ * input file and calc_write() appends the result to a large output buffer,
+ * one value per line. Programs compiled by calc switch to batch mode if the
+ * environment variable CALC_INPUT names the input file; CALC_INPUT_FORMAT
+ * selects "csv" (the default) or "bin".
+ *
+ * In CSV files, every character other than a digit or '-' separates values,
+ * so commas, blanks and newlines can be mixed freely. Binary files hold
+ * native-endian int32 values. In both cases, the values of a row follow
+ * each other in the order of the declared variables.
+ */
+enum calc_input_format { CALC_INPUT_CSV, CALC_INPUT_BINARY };
+
+/* Maps the input file and enters batch mode. Returns 0 on success and -1
+ * on failure. */
+int calc_open_input(const char *path, enum calc_input_format format);
+
+/* Returns 1 if all values of the input have been read. */
+int calc_input_done(void);
+
+/* Writes the buffered results to stdout. Called automatically at exit. */
+void calc_flush(void);
+
+/* Evaluates every row of ncols values of the input file with kernel on
+ * nthreads threads (see calc_run_parallel()) and writes the results like
+ * calc_write(). Trailing values which do not fill a row are ignored.
+ * Returns the number of rows, or -1 on failure. If a row divides by zero or
+ * INT_MIN by -1, only the results before it are written, its index is
+ * stored in *bad_row and -2 is returned. */
+long calc_eval_file(calc_kernel_fn kernel, size_t ncols, const char *path,
+                    enum calc_input_format format, unsigned nthreads, size_t *bad_row);
+
+/* Evaluates the n rows of the ncols columns with kernel on nthreads threads
+ * (0 selects one thread per online CPU) and stores the results in out, which
+ * must have room for n values. Returns 0 on success and -1 on failure. If a
+ * row divides by zero or INT_MIN by -1, the index of the first such row is
+ * stored in *bad_row and 1 is returned; the results of the rows before it
+ * are stored, those of the later rows are unspecified.
+ */
+int calc_run_parallel(calc_kernel_fn kernel, const int32_t *const *cols, size_t ncols,
+                      int32_t *out, size_t n, unsigned nthreads, size_t *bad_row);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,31 +1,32 @@
 #include "Sema.h"
-#include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/BitVector.h"
 // The coding guidelines from LLVM forbid the use of the <iostream> library, 
 // therefore, the header of the equivalent LLVM functionality is included
 // e.g. llvm::errs() is defined in this file
 #include "llvm/Support/raw_ostream.h"
 namespace{
     class DeclCheck : public ASTVisitor {
-        llvm::StringSet<> Scope;
+        llvm::BitVector Scope; // Indexed by identifier ID
+        llvm::raw_ostream &Diags;
         bool HasError;
         enum ErrorType { Twice, Not };
         void error(ErrorType ET, llvm::StringRef V){
-            llvm::errs() << "Variable " << V << " "
+            Diags << "Variable " << V << " "
             << (ET == Twice ? "already" : "not")
             << " declared\n";
             HasError = true;
         }
         public:
-        DeclCheck() : HasError(false){}
+        explicit DeclCheck(llvm::raw_ostream &Diags) : Diags(Diags), HasError(false){}
         bool hasError() { return HasError; }
 
-        // The names were previously stored in a set called Scope by the WithDecl
-        // visitor. On a Factor node that holds a variable name, it is checked 
-        // that the variable name is in the set. This catches variable use without
-        // declaration cases.
+        // The IDs of the names were previously marked in a set called Scope by the
+        // WithDecl visitor. On a Factor node that holds a variable name, it is
+        // checked that the variable is in the set. This catches variable use
+        // without declaration cases.
         virtual void visit(Factor &Node) override {
             if(Node.getKind() == Factor::Ident){
-                if(Scope.find(Node.getVal()) == Scope.end())
+                if(Node.getID() >= Scope.size() || !Scope.test(Node.getID()))
                 error(Not, Node.getVal());
             }
         }
@@ -45,19 +46,24 @@ namespace{
             }
         }
 
-        // Populate the set of variable names, and then confirm that an
-        // expression exists and that it can be successfully visited.
+        // Populate the set of variable names, and then confirm that every
+        // result expression exists and that it can be successfully visited.
         virtual void visit(WithDecl &Node) override {
-            for (auto I = Node.begin(), E = Node.end() ; I != E; ++I){
-                if(!Scope.insert(*I).second)
-                error(Twice, *I);
+            llvm::ArrayRef<unsigned> IDs = Node.getIDs();
+            for (unsigned I = 0, E = IDs.size(); I != E; ++I){
+                if(IDs[I] >= Scope.size())
+                    Scope.resize(IDs[I] + 1);
+                if(Scope.test(IDs[I]))
+                error(Twice, Node.begin()[I]);
+                Scope.set(IDs[I]);
             }
-            if(Node.getExpr()){
-                Node.getExpr()->accept(*this);
-            } else {
-                HasError = true;
+            for (Expr *E : Node.getExprs()){
+                if(E){
+                    E->accept(*this);
+                } else {
+                    HasError = true;
+                }
             }
-            
         }
     };
     
@@ -67,7 +73,7 @@ bool Sema::semantic(AST *Tree){
     if(!Tree){
         return false;
     }
-    DeclCheck Check;
+    DeclCheck Check(Diags);
     Tree->accept(Check);
     return Check.hasError();
 }
@@ -2,8 +2,11 @@
 #define SEMA_H
 #include "AST.h"
 #include "Lexer.h"
+#include "llvm/Support/raw_ostream.h"
 class Sema{
+    llvm::raw_ostream &Diags; // Receives the error messages
 public:
+    explicit Sema(llvm::raw_ostream &Diags = llvm::errs()) : Diags(Diags) {}
     bool semantic(AST *Tree);
 };
 
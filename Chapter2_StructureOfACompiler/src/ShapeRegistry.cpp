@@ -0,0 +1,103 @@
+#include "ShapeRegistry.h"
+#include "CodeGen.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include <memory>
+
+using namespace llvm;
+
+namespace {
+    // Writes the shape of a tree in prefix notation, which needs no
+    // parentheses, and collects the numbers in the same order as the code
+    // generator loads them. Shared nodes of a simplified tree are visited
+    // once per occurrence.
+    class ShapeBuilder : public ASTVisitor{
+        bool HoistConstants;
+        std::vector<unsigned> VarIndex; // Declaration index, by identifier ID
+
+    public:
+        std::string Key;
+        std::vector<int32_t> Consts;
+
+        explicit ShapeBuilder(bool HoistConstants) : HoistConstants(HoistConstants) {}
+
+        virtual void visit(Factor &Node) override {
+            if (Node.getKind() == Factor::Ident){
+                Key += 'v';
+                Key += std::to_string(VarIndex[Node.getID()]);
+                Key += ' ';
+                return;
+            }
+            int Val = 0;
+            Node.getVal().getAsInteger(10, Val);
+            if (HoistConstants){
+                Key += "# ";
+                Consts.push_back(Val);
+            } else {
+                Key += std::to_string(Val);
+                Key += ' ';
+            }
+        }
+
+        virtual void visit(BinaryOp &Node) override {
+            static const char Ops[] = {'+', '-', '*', '/'};
+            Key += Ops[Node.getOperator()];
+            Node.getLeft()->accept(*this);
+            Node.getRight()->accept(*this);
+        }
+
+        virtual void visit(WithDecl &Node) override {
+            ArrayRef<unsigned> IDs = Node.getIDs();
+            for (unsigned I = 0, E = IDs.size(); I != E; ++I){
+                if (IDs[I] >= VarIndex.size())
+                    VarIndex.resize(IDs[I] + 1);
+                VarIndex[IDs[I]] = I;
+            }
+            Key += "with " + std::to_string(IDs.size()) + ": ";
+            for (Expr *E : Node.getExprs())
+                E->accept(*this);
+        }
+    };
+} // unnamed namespace
+
+Expected<ShapeRegistry::Instance> ShapeRegistry::get(AST *Tree){
+    DeclCollector Decls;
+    Tree->accept(Decls);
+    if (Decls.Exprs.size() != 1)
+        return createStringError(inconvertibleErrorCode(), "a shape computes a single result");
+    ShapeBuilder Shape(HoistConstants);
+    Tree->accept(Shape);
+    ++Lookups;
+
+    ShapeFn *&Fn = Shapes[Shape.Key];
+    if (!Fn){
+        std::string Name = ("calc_shape_" + Twine(Lookups)).str(); // Unique, even after a failure
+        auto Ctx = std::make_unique<LLVMContext>();
+        auto M = std::make_unique<Module>("calc.shape", *Ctx);
+        if (TM){
+            M->setDataLayout(TM->createDataLayout());
+            M->setTargetTriple(TM->getTargetTriple().getTriple());
+        }
+        CodeGen CodeGenerator(TM);
+        CodeGenerator.compileResultsFunction(Tree, *M, Name, HoistConstants);
+        CodeGenerator.optimize(*M, OptLevel);
+        if (Error Err = JIT.addModule(std::move(M), std::move(Ctx))){
+            Shapes.erase(Shape.Key);
+            return Err;
+        }
+        // Looking up the function triggers the machine code generation
+        Expected<ShapeFn *> Compiled = JIT.lookupFunction<ShapeFn>(Name);
+        if (!Compiled){
+            Shapes.erase(Shape.Key);
+            return Compiled.takeError();
+        }
+        Fn = *Compiled;
+    }
+    return Instance{Fn, std::move(Shape.Consts)};
+}
+
+void ShapeRegistry::printStats(raw_ostream &OS) const {
+    OS << "Shape registry: " << Lookups << " expressions, " << Shapes.size() << " compiled "
+       << (Shapes.size() == 1 ? "shape" : "shapes") << (HoistConstants ? "" : " (numbers not hoisted)") << "\n";
+}
@@ -0,0 +1,59 @@
+#ifndef SHAPEREGISTRY_H
+#define SHAPEREGISTRY_H
+#include "AST.h"
+#include "JIT.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compiles expressions with the JIT, once per shape. The shape of an
+// expression is the tree with the numbers left out and the variables
+// replaced by their declaration index, so e.g.
+//   with a: a*3+7   and   with b: b*5+2
+// have the same shape. The numbers are hoisted into a constant vector,
+// which is passed to the compiled function of the shape together with
+// the values of the variables (see CodeGen::compileResultsFunction()).
+//
+// Without HoistConstants, the numbers are part of the shape and compiled
+// into the code, so every distinct expression gets a function of its own.
+//
+// The registry is not thread-safe.
+class ShapeRegistry{
+public:
+    using ShapeFn = bool(const int32_t *Vars, int32_t *Result, const int32_t *Consts);
+
+    // A compiled expression: the function of its shape and its numbers
+    struct Instance{
+        ShapeFn *Fn;
+        std::vector<int32_t> Consts;
+
+        // Vars[I] is the value of the I-th declared variable. Returns false
+        // for a division by zero or of INT_MIN by -1.
+        bool eval(const int32_t *Vars, int32_t &Result) const { return Fn(Vars, &Result, Consts.data()); }
+    };
+
+private:
+    CalcJIT &JIT;
+    llvm::TargetMachine *TM;
+    unsigned OptLevel;
+    bool HoistConstants;
+    llvm::StringMap<ShapeFn *> Shapes;
+    unsigned Lookups = 0;
+
+public:
+    ShapeRegistry(CalcJIT &JIT, llvm::TargetMachine *TM, unsigned OptLevel, bool HoistConstants = true)
+        : JIT(JIT), TM(TM), OptLevel(OptLevel), HoistConstants(HoistConstants) {}
+
+    // Returns the compiled function of the shape of the checked Tree, which
+    // is compiled on the first request, and the numbers of Tree.
+    llvm::Expected<Instance> get(AST *Tree);
+
+    unsigned getNumShapes() const { return Shapes.size(); }
+    void printStats(llvm::raw_ostream &OS) const;
+};
+
+#endif
@@ -0,0 +1,207 @@
+#include "Simplify.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include <climits>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+    // Rebuilds the expression bottom-up. As the operands of a binary
+    // operation are already unique, two operations are structurally equal
+    // exactly if they have the same operator and operand pointers.
+    class SimplifyVisitor : public ASTVisitor{
+        ASTContext &Ctx;
+        bool Fold;
+        const DenseMap<unsigned, int32_t> &Bound;
+        DenseMap<int64_t, Factor *> Numbers; // Keyed by value, so 012 and 12 are shared too
+        std::vector<Factor *> Idents; // Indexed by identifier ID
+        DenseMap<std::tuple<unsigned, Expr *, Expr *>, BinaryOp *> BinaryOps;
+
+        public:
+        AST *Root = nullptr;
+        Expr *Result = nullptr;
+        bool ResultIsNumber = false;
+        int ResultValue = 0; // The value of Result if it is a number
+        unsigned NumNodes = 0;
+        unsigned NumFolded = 0;
+        unsigned NumShared = 0;
+        unsigned NumBound = 0;
+
+        SimplifyVisitor(ASTContext &Ctx, bool Fold, const DenseMap<unsigned, int32_t> &Bound)
+            : Ctx(Ctx), Fold(Fold), Bound(Bound) {}
+
+        // Existing is the node with this value from the input, if any
+        void setNumber(int Val, Factor *Existing = nullptr){
+            Factor *F = Fold ? Numbers.lookup(Val) : nullptr;
+            if (!F){
+                F = Existing ? Existing : new (Ctx) Factor(Factor::Number, Ctx.copyString(std::to_string(Val)));
+                if (Fold)
+                    Numbers[Val] = F;
+            }
+            Result = F;
+            ResultIsNumber = true;
+            ResultValue = Val;
+        }
+
+        // Computes the operation with 32 bit wrap-around. Returns false if
+        // the result is undefined, so that the division stays in the code.
+        static bool fold(BinaryOp::Operator Op, int L, int R, int &Val){
+            uint32_t UL = static_cast<uint32_t>(L), UR = static_cast<uint32_t>(R);
+            switch (Op){
+            case BinaryOp::Plus:
+                Val = static_cast<int32_t>(UL + UR);
+                return true;
+            case BinaryOp::Minus:
+                Val = static_cast<int32_t>(UL - UR);
+                return true;
+            case BinaryOp::Mul:
+                Val = static_cast<int32_t>(UL * UR);
+                return true;
+            case BinaryOp::Div:
+                if (R == 0 || (L == INT_MIN && R == -1))
+                    return false;
+                Val = L / R;
+                return true;
+            }
+            return false;
+        }
+
+        virtual void visit(Factor &Node) override {
+            ++NumNodes;
+            if (Node.getKind() == Factor::Number){
+                // Same conversion as in the code generator: text which does
+                // not fit into an int yields 0
+                int Val = 0;
+                Node.getVal().getAsInteger(10, Val);
+                setNumber(Val, &Node);
+            } else if (Bound.count(Node.getID())){
+                ++NumBound;
+                setNumber(Bound.lookup(Node.getID()));
+                return;
+            } else if (!Fold){
+                Result = &Node;
+                ResultIsNumber = false;
+            } else {
+                if (Node.getID() >= Idents.size())
+                    Idents.resize(Node.getID() + 1);
+                Factor *&F = Idents[Node.getID()];
+                if (!F)
+                    F = &Node;
+                Result = F;
+                ResultIsNumber = false;
+            }
+            if (Result != &Node)
+                ++NumShared;
+        }
+
+        virtual void visit(BinaryOp &Node) override {
+            ++NumNodes;
+            Node.getLeft()->accept(*this);
+            Expr *Left = Result;
+            bool LeftIsNumber = ResultIsNumber;
+            int LeftValue = ResultValue;
+            Node.getRight()->accept(*this);
+            Expr *Right = Result;
+
+            int Val;
+            if (Fold && LeftIsNumber && ResultIsNumber && fold(Node.getOperator(), LeftValue, ResultValue, Val)){
+                ++NumFolded;
+                setNumber(Val);
+                return;
+            }
+            if (!Fold){
+                Result = Left == Node.getLeft() && Right == Node.getRight() ? &Node : new (Ctx) BinaryOp(Node.getOperator(), Left, Right);
+                ResultIsNumber = false;
+                return;
+            }
+
+            BinaryOp *&Op = BinaryOps[std::make_tuple(static_cast<unsigned>(Node.getOperator()), Left, Right)];
+            if (Op)
+                ++NumShared;
+            else if (Left == Node.getLeft() && Right == Node.getRight())
+                Op = &Node;
+            else
+                Op = new (Ctx) BinaryOp(Node.getOperator(), Left, Right);
+            Result = Op;
+            ResultIsNumber = false;
+        }
+
+        virtual void visit(WithDecl &Node) override {
+            // The results are simplified with the same tables, so subexpressions
+            // are also shared between them
+            SmallVector<Expr *, 4> Results;
+            for (Expr *E : Node.getExprs()){
+                E->accept(*this);
+                Results.push_back(Result);
+            }
+            // Bound variables are dropped from the declaration. Otherwise the
+            // variable list already lives in the context and is reused.
+            ArrayRef<StringRef> Vars(Node.begin(), Node.end());
+            ArrayRef<unsigned> IDs = Node.getIDs();
+            SmallVector<StringRef, 8> FreeVars;
+            SmallVector<unsigned, 8> FreeIDs;
+            for (unsigned I = 0, E = IDs.size(); I != E; ++I){
+                if (!Bound.count(IDs[I])){
+                    FreeVars.push_back(Vars[I]);
+                    FreeIDs.push_back(IDs[I]);
+                }
+            }
+            if (FreeIDs.empty() && Results.size() == 1)
+                Root = Result;
+            else if (FreeIDs.size() != IDs.size())
+                Root = new (Ctx) WithDecl(Ctx.copy<StringRef>(FreeVars), Ctx.copy<unsigned>(FreeIDs), Ctx.copy<Expr *>(Results));
+            else if (Node.getExprs() == ArrayRef<Expr *>(Results))
+                Root = &Node;
+            else
+                Root = new (Ctx) WithDecl(Vars, IDs, Ctx.copy<Expr *>(Results));
+        }
+
+        void simplify(AST *Tree){
+            Tree->accept(*this);
+            if (!Root)
+                Root = Result;
+        }
+    };
+
+    // Counts the distinct expression nodes of a DAG
+    class NodeCounter : public ASTVisitor{
+        SmallPtrSet<Expr *, 32> Seen;
+        public:
+        unsigned size() const { return Seen.size(); }
+        virtual void visit(Factor &Node) override { Seen.insert(&Node); }
+        virtual void visit(BinaryOp &Node) override {
+            if (!Seen.insert(&Node).second)
+                return;
+            Node.getLeft()->accept(*this);
+            Node.getRight()->accept(*this);
+        }
+        virtual void visit(WithDecl &Node) override {
+            for (Expr *E : Node.getExprs())
+                E->accept(*this);
+        }
+    };
+} // unnamed namespace
+
+AST *Simplifier::simplify(AST *Tree){
+    SimplifyVisitor Simplify(Ctx, Fold, Bound);
+    Simplify.simplify(Tree);
+    NodeCounter Counter;
+    Simplify.Root->accept(Counter);
+    NodesBefore += Simplify.NumNodes;
+    NodesAfter += Counter.size();
+    NumFolded += Simplify.NumFolded;
+    NumShared += Simplify.NumShared;
+    NumBound += Simplify.NumBound;
+    return Simplify.Root;
+}
+
+void Simplifier::printStats(raw_ostream &OS) const {
+    OS << "Simplifier statistics:\n";
+    OS << "  expression nodes:    " << NodesBefore << " -> " << NodesAfter << "\n";
+    OS << "  folded operations:   " << NumFolded << "\n";
+    OS << "  shared nodes:        " << NumShared << "\n";
+    OS << "  bound variable uses: " << NumBound << "\n";
+}
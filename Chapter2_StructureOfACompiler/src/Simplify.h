@@ -0,0 +1,43 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+#include "AST.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+
+// Simplifies a checked tree before code generation:
+//  - A binary operation of two numbers is replaced by its result, e.g.
+//    (3*4)+a becomes 12+a. +, - and * wrap around like the generated code
+//    and the bytecode, so a folded overflow gives the same result as at run
+//    time. Divisions by zero and INT_MIN/-1 are kept, so that they behave
+//    at run time exactly as without folding.
+//  - Structurally identical subexpressions are replaced by one shared node,
+//    e.g. both (a+b) in (a+b)*(a+b). The result is a DAG, which the code
+//    generator translates once per distinct node.
+//  - Variables bound with bind() are replaced by their value and removed
+//    from the declaration, so they are no longer read at run time, and
+//    the operations on them are folded like any other numbers.
+// Without Fold, only the bound variables are replaced.
+// New nodes are created in the ASTContext of the tree.
+class Simplifier{
+    ASTContext &Ctx;
+    bool Fold;
+    llvm::DenseMap<unsigned, int32_t> Bound; // Keyed by identifier ID
+    unsigned NodesBefore = 0; // Expression nodes of the input tree
+    unsigned NodesAfter = 0;  // Distinct expression nodes of the result
+    unsigned NumFolded = 0;
+    unsigned NumShared = 0;
+    unsigned NumBound = 0;
+
+public:
+    explicit Simplifier(ASTContext &Ctx, bool Fold = true) : Ctx(Ctx), Fold(Fold) {}
+
+    // Binds the variable Name to Value in the trees simplified afterwards.
+    // Trees which do not declare Name are not affected.
+    void bind(llvm::StringRef Name, int32_t Value) { Bound[Ctx.getIdentifierID(Name)] = Value; }
+
+    AST *simplify(AST *Tree);
+    void printStats(llvm::raw_ostream &OS) const;
+};
+
+#endif
@@ -0,0 +1,261 @@
+#include "StreamCompiler.h"
+#include "Lexer.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/IRBuilder.h"
+#include <cstdint>
+#include <string>
+
+using namespace llvm;
+
+namespace {
+    // Parses the tokens of one expression and emits the IR of main() on the
+    // way. The structure follows Parser::parseCalc() and
+    // Parser::parseExprIterative(), with the operands being the values of
+    // the subexpressions instead of nodes.
+    class StreamParser{
+        Lexer Lex;
+        Token Tok;
+        Module *M;
+        IRBuilder<> Builder;
+        Type *Int32Ty;
+        PointerType *PtrTy;
+        Function *ReadFn = nullptr; // calc_read(), declared on the first use
+        BasicBlock *DivError = nullptr; // Target of the divisions which would trap
+        const StringMap<int32_t> &Bindings;
+        StringMap<Value *> &Vars;
+        raw_ostream &Diags;
+        std::string SemaDiags; // Only reported if there is no syntax error
+        raw_string_ostream SemaOS{SemaDiags};
+
+        void advance() { Lex.next(Tok); }
+
+        void error(){
+            Diags << "Unexpected: " << Tok.getText() << "\n";
+            HasSyntaxError = true;
+        }
+
+        // The same messages as the DeclCheck of Sema
+        void semaError(bool Twice, StringRef Name){
+            SemaOS << "Variable " << Name << " " << (Twice ? "already" : "not") << " declared\n";
+            HasSemanticError = true;
+        }
+
+        // Skips the rest of the input after a syntax error
+        void recover(){
+            while (!Tok.is(Token::eoi))
+                advance();
+        }
+
+        // Emits the call of calc_read() for a declared variable, or uses the
+        // value it is bound to
+        void declare(StringRef Name){
+            auto Inserted = Vars.try_emplace(Name, nullptr);
+            if (!Inserted.second){
+                semaError(true, Name);
+                return;
+            }
+            auto Bound = Bindings.find(Name);
+            if (Bound != Bindings.end()){
+                Inserted.first->second = ConstantInt::get(Int32Ty, Bound->second, true);
+                return;
+            }
+            FunctionType *ReadFty = FunctionType::get(Int32Ty, {PtrTy}, false);
+            if (!ReadFn)
+                ReadFn = Function::Create(ReadFty, GlobalValue::ExternalLinkage, "calc_read", M);
+            Constant *StrText = ConstantDataArray::getString(M->getContext(), Name);
+            GlobalVariable *Str = new GlobalVariable(*M, StrText->getType(), /*isConstant=*/true,
+                                                     GlobalValue::PrivateLinkage, StrText, Twine(Name).concat(".str"));
+            Inserted.first->second = Builder.CreateCall(ReadFty, ReadFn, {Str});
+        }
+
+        Value *operand(){
+            if (Tok.is(Token::number)){
+                int Val = 0;
+                Tok.getText().getAsInteger(10, Val);
+                return ConstantInt::get(Int32Ty, Val, true);
+            }
+            Value *Var = Vars.lookup(Tok.getText());
+            if (!Var){
+                semaError(false, Tok.getText());
+                return ConstantInt::get(Int32Ty, 0); // Parsing goes on to find further errors
+            }
+            return Var;
+        }
+
+        Value *emit(Token::TokenKind Op, Value *Left, Value *Right){
+            switch (Op){
+            case Token::plus: return Builder.CreateAdd(Left, Right);
+            case Token::minus: return Builder.CreateSub(Left, Right);
+            case Token::star: return Builder.CreateMul(Left, Right);
+            default:
+                checkDiv(Left, Right);
+                return Builder.CreateSDiv(Left, Right);
+            }
+        }
+
+        // Like ToIRVisitor::checkDiv() of the CodeGen, continues in a new
+        // block if Left / Right does not trap
+        void checkDiv(Value *Left, Value *Right){
+            Function *Fn = Builder.GetInsertBlock()->getParent();
+            if (!DivError)
+                DivError = BasicBlock::Create(M->getContext(), "div.error", Fn);
+            Value *ByZero = Builder.CreateICmpEQ(Right, ConstantInt::get(Int32Ty, 0));
+            Value *Overflow = Builder.CreateAnd(Builder.CreateICmpEQ(Left, ConstantInt::get(Int32Ty, INT32_MIN, true)),
+                                                Builder.CreateICmpEQ(Right, ConstantInt::get(Int32Ty, -1, true)));
+            BasicBlock *Ok = BasicBlock::Create(M->getContext(), "div.ok", Fn, DivError);
+            Builder.CreateCondBr(Builder.CreateOr(ByZero, Overflow), DivError, Ok);
+            Builder.SetInsertPoint(Ok);
+        }
+
+        // Implements
+        //   expr : term (( "+" | "-" ) term)* ;
+        // like Parser::parseExprIterative(). An operation is emitted when it
+        // is reduced, which happens in the order a post-order traversal of
+        // the tree would visit it.
+        Value *parseExpr(){
+            // A pending operator, or an opening parenthesis with precedence 0
+            struct PendingOp{
+                Token::TokenKind Op;
+                unsigned Prec;
+            };
+            SmallVector<PendingOp, 32> Ops;
+            SmallVector<Value *, 32> Operands;
+
+            auto reduce = [&]{
+                Value *Right = Operands.pop_back_val();
+                Value *&Left = Operands.back();
+                Left = emit(Ops.pop_back_val().Op, Left, Right);
+            };
+
+            for (;;){
+                while (Tok.is(Token::l_paren)){
+                    Ops.push_back({Token::l_paren, 0});
+                    advance();
+                }
+                if (!Tok.isOneOf(Token::number, Token::ident))
+                    goto _error;
+                Operands.push_back(operand());
+                advance();
+
+                while (Tok.is(Token::r_paren)){
+                    while (!Ops.empty() && Ops.back().Prec)
+                        reduce();
+                    if (Ops.empty())
+                        break;
+                    Ops.pop_back();
+                    advance();
+                }
+
+                unsigned Prec;
+                switch (Tok.getKind()){
+                case Token::plus: case Token::minus: Prec = 1; break;
+                case Token::star: case Token::slash: Prec = 2; break;
+                default: goto _done;
+                }
+                while (!Ops.empty() && Ops.back().Prec >= Prec)
+                    reduce();
+                Ops.push_back({Tok.getKind(), Prec});
+                advance();
+            }
+
+            _done:
+            while (!Ops.empty()){
+                if (!Ops.back().Prec)
+                    goto _error; // Missing closing parenthesis
+                reduce();
+            }
+            return Operands.pop_back_val();
+
+            _error:
+            error();
+            recover();
+            return nullptr;
+        }
+
+    public:
+        bool HasSyntaxError = false;
+        bool HasSemanticError = false;
+
+        StreamParser(StringRef Input, Module *M, const StringMap<int32_t> &Bindings, StringMap<Value *> &Vars,
+                     raw_ostream &Diags)
+            : Lex(Input), M(M), Builder(M->getContext()), Bindings(Bindings), Vars(Vars), Diags(Diags){
+            Int32Ty = Type::getInt32Ty(M->getContext());
+            PtrTy = PointerType::getUnqual(M->getContext());
+            advance();
+        }
+
+        // Implements
+        //    calc : ("with" ident ("," ident)* ":")? expr ("," expr)* ;
+        // and emits main() with the same instructions as CodeGen::compile()
+        void parse(){
+            FunctionType *MainFty = FunctionType::get(Int32Ty, {Int32Ty, PtrTy}, false);
+            Function *MainFn = Function::Create(MainFty, GlobalValue::ExternalLinkage, "main", M);
+            Builder.SetInsertPoint(BasicBlock::Create(M->getContext(), "entry", MainFn));
+
+            if (Tok.is(Token::KW_with)){
+                do {
+                    advance();
+                    if (!Tok.is(Token::ident)){
+                        error();
+                        recover();
+                        return;
+                    }
+                    declare(Tok.getText());
+                    advance();
+                } while (Tok.is(Token::comma));
+                if (!Tok.is(Token::colon)){
+                    error();
+                    recover();
+                    return;
+                }
+                advance();
+            }
+
+            // The results are written after all of them are computed, like
+            // CodeGen::compile() does
+            SmallVector<Value *, 4> Results;
+            Results.push_back(parseExpr());
+            while (!HasSyntaxError && Tok.is(Token::comma)){
+                advance();
+                Results.push_back(parseExpr());
+            }
+            if (!HasSyntaxError && !Tok.is(Token::eoi))
+                error();
+            if (HasSyntaxError)
+                return;
+            Diags << SemaOS.str();
+            if (HasSemanticError)
+                return;
+
+            FunctionType *CalcWriteFnTy = FunctionType::get(Type::getVoidTy(M->getContext()), {Int32Ty}, false);
+            Function *CalcWriteFn = Function::Create(CalcWriteFnTy, GlobalValue::ExternalLinkage, "calc_write", M);
+            for (Value *Result : Results)
+                Builder.CreateCall(CalcWriteFnTy, CalcWriteFn, {Result});
+            Builder.CreateRet(ConstantInt::get(Int32Ty, 0, true));
+
+            if (DivError){
+                FunctionType *DivErrorFnTy = FunctionType::get(Type::getVoidTy(M->getContext()), false);
+                Function *DivErrorFn = Function::Create(DivErrorFnTy, GlobalValue::ExternalLinkage, "calc_div_error", M);
+                Builder.SetInsertPoint(DivError);
+                Builder.CreateCall(DivErrorFnTy, DivErrorFn);
+                Builder.CreateRet(ConstantInt::get(Int32Ty, 1));
+            }
+        }
+    };
+} // unnamed namespace
+
+std::unique_ptr<Module> StreamCompiler::compile(StringRef Input, LLVMContext &Ctx){
+    auto M = std::make_unique<Module>("calc.expr", Ctx);
+    if (TM){
+        M->setDataLayout(TM->createDataLayout());
+        M->setTargetTriple(TM->getTargetTriple().getTriple());
+    }
+    Vars.clear();
+    StreamParser Parser(Input, M.get(), Bindings, Vars, Diags);
+    Parser.parse();
+    HasSyntaxError = Parser.HasSyntaxError;
+    HasSemanticError = Parser.HasSemanticError;
+    if (HasSyntaxError || HasSemanticError)
+        return nullptr;
+    return M;
+}
@@ -0,0 +1,53 @@
+#ifndef STREAMCOMPILER_H
+#define STREAMCOMPILER_H
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Value.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include <cstdint>
+#include <memory>
+
+// Translates an expression into a module with main(), like the Parser,
+// Sema and CodeGen::compile() together, but in a single pass over the
+// tokens: the IR of an operation is emitted as soon as the parser has seen
+// both operands, and the declaration checks are made as the names are
+// read. No AST is built, which saves the allocation of the nodes and two
+// traversals of the tree, the largest part of the compile time of small
+// expressions.
+//
+// The expression is parsed like Parser::OperatorPrecedence does, so any
+// nesting depth works. There is no Simplifier: the IRBuilder folds
+// operations on numbers, but identical subexpressions are emitted once per
+// use and left to the optimizer. The IR is the same as that of the three
+// phases with -fold=false.
+class StreamCompiler{
+    llvm::TargetMachine *TM;
+    llvm::raw_ostream &Diags; // Receives the error messages
+    llvm::StringMap<int32_t> Bindings;
+    llvm::StringMap<llvm::Value *> Vars; // The variables declared by the last compile()
+    bool HasSyntaxError = false;
+    bool HasSemanticError = false;
+
+public:
+    explicit StreamCompiler(llvm::TargetMachine *TM = nullptr, llvm::raw_ostream &Diags = llvm::errs())
+        : TM(TM), Diags(Diags) {}
+
+    // Binds a declared variable to Value like Simplifier::bind(), so it is
+    // not read with calc_read()
+    void bind(llvm::StringRef Name, int32_t Value) { Bindings[Name] = Value; }
+
+    // Returns nullptr if the expression has an error. As with the separate
+    // phases, semantic errors are only reported if there is no syntax error.
+    std::unique_ptr<llvm::Module> compile(llvm::StringRef Input, llvm::LLVMContext &Ctx);
+
+    bool hasSyntaxError() const { return HasSyntaxError; }
+    bool hasSemanticError() const { return HasSemanticError; }
+
+    // Returns true if the last compiled expression declared Name
+    bool declares(llvm::StringRef Name) const { return Vars.count(Name); }
+};
+
+#endif
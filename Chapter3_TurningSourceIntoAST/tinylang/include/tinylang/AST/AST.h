@@ -1,12 +1,14 @@
 #ifndef TINYLANG_AST_AST_H
 #define TINYLANG_AST_AST_H
+#include "tinylang/Basic/IdentifierTable.h"
 #include "tinylang/Basic/LLVM.h"
 #include "tinylang/Basic/TokenKinds.h"
 #include "llvm/ADT/APSInt.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/SMLoc.h"
 #include <string>
-#include <vector>
 
 namespace tinylang{
     class Decl;
@@ -14,10 +16,13 @@ namespace tinylang{
     class Expr;
     class Stmt;
 
-    using DeclList = std::vector<Decl *>;
-    using FormalParamList = std::vector<FormalParameterDeclaration *>;
-    using ExprList = std::vector<Expr *>;
-    using StmtList = std::vector<Stmt *>;
+    // The parser collects the children of a node in these lists, mostly
+    // without touching the heap. Sema copies a finished list once into the
+    // ASTContext, and the node refers to that copy.
+    using DeclList = llvm::SmallVector<Decl *, 8>;
+    using FormalParamList = llvm::SmallVector<FormalParameterDeclaration *, 4>;
+    using ExprList = llvm::SmallVector<Expr *, 4>;
+    using StmtList = llvm::SmallVector<Stmt *, 8>;
 
     class Ident {
         SMLoc Loc;
@@ -29,7 +34,7 @@ namespace tinylang{
         const StringRef &getName() { return Name; }
     };
 
-    using IdentList = std::vector<std::pair<SMLoc, StringRef>>;
+    using IdentList = llvm::SmallVector<std::pair<SMLoc, IdentifierInfo *>, 4>;
 
     class Decl {
         public:
@@ -46,33 +51,34 @@ namespace tinylang{
         protected:
         Decl *EnclosingDecL;
         SMLoc Loc; // Location of the name
-        StringRef Name; // Name of the declaration
+        IdentifierInfo *Name; // Name of the declaration
 
         public:
-        Decl(DeclKind Kind, Decl *EnclosingDecL, SMLoc Loc, StringRef Name)
+        Decl(DeclKind Kind, Decl *EnclosingDecL, SMLoc Loc, IdentifierInfo *Name)
             : Kind(Kind), EnclosingDecL(EnclosingDecL), Loc(Loc), Name(Name) {}
 
         DeclKind getKind() const noexcept { return Kind; }
         SMLoc getLocation() const noexcept { return Loc; }
-        StringRef getName() const noexcept { return Name; }
+        IdentifierInfo *getIdentifier() const noexcept { return Name; }
+        StringRef getName() const { return Name->getName(); }
         Decl *getEnclosingDecl() const noexcept { return EnclosingDecL; }
     };
 
     class ModuleDeclaration : public Decl {
-        DeclList Decls;
-        StmtList Stmts;
+        ArrayRef<Decl *> Decls;
+        ArrayRef<Stmt *> Stmts;
 
         public:
-        ModuleDeclaration(Decl *EnclosingDecL, SMLoc Loc, StringRef Name)
+        ModuleDeclaration(Decl *EnclosingDecL, SMLoc Loc, IdentifierInfo *Name)
         : Decl(DK_Module, EnclosingDecL, Loc, Name) {}
-        ModuleDeclaration(Decl *EnclosingDecL, SMLoc Loc, StringRef Name, DeclList &Decls, StmtList &Stmts)
+        ModuleDeclaration(Decl *EnclosingDecL, SMLoc Loc, IdentifierInfo *Name, ArrayRef<Decl *> Decls, ArrayRef<Stmt *> Stmts)
         : Decl(DK_Module, EnclosingDecL, Loc, Name),
         Decls(Decls), Stmts(Stmts) {}
 
-        const DeclList &getDecls() noexcept { return Decls; }
-        void setDecls(DeclList &NewDecList) { Decls = NewDecList; }
-        const StmtList &getStmts() noexcept { return Stmts; }
-        void setStmts(StmtList &NewStmtList) noexcept { Stmts = NewStmtList; }
+        ArrayRef<Decl *> getDecls() noexcept { return Decls; }
+        void setDecls(ArrayRef<Decl *> NewDecList) { Decls = NewDecList; }
+        ArrayRef<Stmt *> getStmts() noexcept { return Stmts; }
+        void setStmts(ArrayRef<Stmt *> NewStmtList) noexcept { Stmts = NewStmtList; }
 
         static bool classof(const Decl *DeclToCheck) {
             return DeclToCheck->getKind() == DK_Module;
@@ -83,7 +89,7 @@ namespace tinylang{
         Expr *Expression;
 
         public:
-        ConstantDeclaration(Decl *EnclosingDecL, SMLoc Loc, StringRef Name, Expr *Expression)
+        ConstantDeclaration(Decl *EnclosingDecL, SMLoc Loc, IdentifierInfo *Name, Expr *Expression)
         : Decl(DK_Const, EnclosingDecL, Loc, Name), Expression(Expression) {}
         Expr *getExpr() { return Expression; }
 
@@ -94,7 +100,7 @@ namespace tinylang{
 
     class TypeDeclaration : public Decl {
         public:
-        TypeDeclaration(Decl *EnclosingDecL, SMLoc Loc, StringRef Name)
+        TypeDeclaration(Decl *EnclosingDecL, SMLoc Loc, IdentifierInfo *Name)
         : Decl(DK_Type, EnclosingDecL, Loc, Name) {}
 
         static bool classof(const Decl *DeclToCheck) {
@@ -106,7 +112,7 @@ namespace tinylang{
         TypeDeclaration *Ty;
 
         public:
-        VariableDeclaration(Decl *EnclosingDecL, SMLoc Loc, StringRef Name, TypeDeclaration *Ty)
+        VariableDeclaration(Decl *EnclosingDecL, SMLoc Loc, IdentifierInfo *Name, TypeDeclaration *Ty)
         : Decl(DK_Var, EnclosingDecL, Loc, Name), Ty(Ty)  {}
 
         TypeDeclaration *getType() noexcept { return Ty; }
@@ -121,7 +127,7 @@ namespace tinylang{
         bool IsVar;
 
         public:
-        FormalParameterDeclaration(Decl *EnclosingDecL, SMLoc Loc, StringRef Name, TypeDeclaration *Ty, bool IsVar)
+        FormalParameterDeclaration(Decl *EnclosingDecL, SMLoc Loc, IdentifierInfo *Name, TypeDeclaration *Ty, bool IsVar)
         : Decl(DK_Param, EnclosingDecL, Loc, Name), Ty(Ty), IsVar(IsVar) {}
 
         TypeDeclaration *getType() noexcept { return Ty; }
@@ -133,27 +139,27 @@ namespace tinylang{
     };
 
     class ProcedureDeclaration : public Decl {
-        FormalParamList Params;
-        TypeDeclaration *RetType;
-        DeclList Decls;
-        StmtList Stmts;
+        ArrayRef<FormalParameterDeclaration *> Params;
+        TypeDeclaration *RetType = nullptr;
+        ArrayRef<Decl *> Decls;
+        ArrayRef<Stmt *> Stmts;
 
         public:
-        ProcedureDeclaration(Decl *EnclosingDecL, SMLoc Loc, StringRef Name)
+        ProcedureDeclaration(Decl *EnclosingDecL, SMLoc Loc, IdentifierInfo *Name)
         : Decl(DK_Proc, EnclosingDecL, Loc, Name) {}
 
-        ProcedureDeclaration(Decl *EnclosingDecL, SMLoc Loc, StringRef Name, FormalParamList &Params,
-        TypeDeclaration *RetType, DeclList &Decls, StmtList &Stmts)
+        ProcedureDeclaration(Decl *EnclosingDecL, SMLoc Loc, IdentifierInfo *Name, ArrayRef<FormalParameterDeclaration *> Params,
+        TypeDeclaration *RetType, ArrayRef<Decl *> Decls, ArrayRef<Stmt *> Stmts)
         : Decl(DK_Proc, EnclosingDecL, Loc, Name), Params(Params), RetType(RetType), Decls(Decls), Stmts(Stmts) {}
 
-        const FormalParamList &getFormalParams() noexcept { return Params; }
-        void setFormalParams(FormalParamList &FP) {Params = FP; }
+        ArrayRef<FormalParameterDeclaration *> getFormalParams() noexcept { return Params; }
+        void setFormalParams(ArrayRef<FormalParameterDeclaration *> FP) {Params = FP; }
         TypeDeclaration *getReturnType() noexcept { return RetType; }
         void setReturnType(TypeDeclaration *Ty) { RetType = Ty; }
-        const DeclList &getDecls() noexcept { return Decls; }
-        void setDecls(DeclList &D) { Decls = D; }
-        const StmtList &getStmts() noexcept { return Stmts; }
-        void setStmts(StmtList &L) { Stmts = L; }
+        ArrayRef<Decl *> getDecls() noexcept { return Decls; }
+        void setDecls(ArrayRef<Decl *> D) { Decls = D; }
+        ArrayRef<Stmt *> getStmts() noexcept { return Stmts; }
+        void setStmts(ArrayRef<Stmt *> L) { Stmts = L; }
 
         static bool classof(const Decl *DeclToCheck) {
             return DeclToCheck->getKind() == DK_Proc;
@@ -290,14 +296,14 @@ namespace tinylang{
 
     class FunctionCallExpr : public Expr {
         ProcedureDeclaration *Proc;
-        ExprList Params;
+        ArrayRef<Expr *> Params;
 
         public:
-        FunctionCallExpr(ProcedureDeclaration *Proc, ExprList Params)
+        FunctionCallExpr(ProcedureDeclaration *Proc, ArrayRef<Expr *> Params)
         : Expr(EK_Func, Proc->getReturnType(), false), Proc(Proc), Params(Params) {}
 
         ProcedureDeclaration *geDecl() noexcept { return Proc; }
-        const ExprList &getParams() noexcept { return Params; }
+        ArrayRef<Expr *> getParams() noexcept { return Params; }
 
         static bool classof(const Expr *ExprToCheck){
             return ExprToCheck->getKind() == EK_Func;
@@ -341,14 +347,14 @@ namespace tinylang{
 
     class ProcedureCallStatement : public Stmt {
         ProcedureDeclaration *Proc;
-        ExprList Params;
+        ArrayRef<Expr *> Params;
 
         public:
-        ProcedureCallStatement(ProcedureDeclaration *Proc, ExprList &Params)
+        ProcedureCallStatement(ProcedureDeclaration *Proc, ArrayRef<Expr *> Params)
         : Stmt(SK_ProcCall), Proc(Proc), Params(Params) {}
 
         ProcedureDeclaration *getProc() noexcept { return Proc; }
-        const ExprList &getParams() noexcept { return Params; }
+        ArrayRef<Expr *> getParams() noexcept { return Params; }
 
         static bool classof(const Stmt *StmtToCheck) {
             return StmtToCheck->getKind() == SK_ProcCall;
@@ -357,16 +363,16 @@ namespace tinylang{
 
     class IfStatement : public Stmt {
         Expr *Cond;
-        StmtList IfStmts;
-        StmtList ElseStmts;
+        ArrayRef<Stmt *> IfStmts;
+        ArrayRef<Stmt *> ElseStmts;
 
         public:
-        IfStatement(Expr *Cond, StmtList &IfStmts, StmtList &ElseStmts)
+        IfStatement(Expr *Cond, ArrayRef<Stmt *> IfStmts, ArrayRef<Stmt *> ElseStmts)
         : Stmt(SK_If), Cond(Cond), IfStmts(IfStmts), ElseStmts(ElseStmts) {}
 
         Expr *getCond() noexcept { return Cond; }
-        const StmtList &getIfStmts() noexcept { return IfStmts; }
-        const StmtList &getElseStmts() noexcept { return ElseStmts; }
+        ArrayRef<Stmt *> getIfStmts() noexcept { return IfStmts; }
+        ArrayRef<Stmt *> getElseStmts() noexcept { return ElseStmts; }
 
         static bool classof(const Stmt *StmtToCheck) {
             return StmtToCheck->getKind() == SK_If;
@@ -375,14 +381,14 @@ namespace tinylang{
 
     class WhileStatement : public Stmt {
         Expr *Cond;
-        StmtList Stmts;
+        ArrayRef<Stmt *> Stmts;
 
         public:
-        WhileStatement(Expr *Cond, StmtList &Stmts)
+        WhileStatement(Expr *Cond, ArrayRef<Stmt *> Stmts)
         : Stmt(SK_While), Cond(Cond), Stmts(Stmts) {}
 
         Expr *getCond() noexcept { return Cond; }
-        const StmtList &getWhileStmts() noexcept { return Stmts; }
+        ArrayRef<Stmt *> getWhileStmts() noexcept { return Stmts; }
 
         static bool classof(const Stmt *StmtToCheck) {
             return StmtToCheck->getKind() == SK_While;
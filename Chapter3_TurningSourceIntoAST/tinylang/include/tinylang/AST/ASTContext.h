@@ -0,0 +1,156 @@
+#ifndef TINYLANG_AST_ASTCONTEXT_H
+#define TINYLANG_AST_ASTCONTEXT_H
+#include "tinylang/AST/AST.h"
+#include "tinylang/Basic/LLVM.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Allocator.h"
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace tinylang {
+
+    // Owns every AST node of a compilation unit. The nodes are placed into a
+    // bump-pointer arena, so creating one is a pointer increment instead of
+    // a call to malloc, and all of them are released together when the
+    // context is destroyed.
+    class ASTContext {
+        llvm::BumpPtrAllocator Allocator;
+        IdentifierTable &Idents;
+
+        // Nodes holding members with their own heap storage must still have
+        // their destructor run before the arena goes away
+        llvm::SmallVector<std::pair<void (*)(void *), void *>, 16> Deallocs;
+
+        struct NodeStats {
+            unsigned Count = 0;
+            size_t Bytes = 0;
+        };
+        NodeStats DeclStats, ExprStats, StmtStats, ListStats;
+
+        template<typename T>
+        NodeStats &getStats() {
+            if constexpr (std::is_base_of_v<Decl, T>) {
+                return DeclStats;
+            } else if constexpr (std::is_base_of_v<Expr, T>) {
+                return ExprStats;
+            } else {
+                static_assert(std::is_base_of_v<Stmt, T>, "Not an AST node");
+                return StmtStats;
+            }
+        }
+
+        template<typename T, typename... Args>
+        T *create(Args &&...Arguments) {
+            NodeStats &Stats = getStats<T>();
+            ++Stats.Count;
+            Stats.Bytes += sizeof(T);
+            T *Node = new (Allocator.Allocate<T>()) T(std::forward<Args>(Arguments)...);
+            if constexpr (!std::is_trivially_destructible_v<T>) {
+                Deallocs.push_back({[](void *Ptr) { static_cast<T *>(Ptr)->~T(); }, Node});
+            }
+            return Node;
+        }
+
+    public:
+        explicit ASTContext(IdentifierTable &Idents) : Idents(Idents) {}
+        ASTContext(const ASTContext &) = delete;
+        ASTContext &operator=(const ASTContext &) = delete;
+        ~ASTContext();
+
+        IdentifierTable &getIdentifierTable() { return Idents; }
+
+        // Declarations
+        ModuleDeclaration *createModuleDeclaration(Decl *EnclosingDecL, SMLoc Loc, IdentifierInfo *Name) {
+            return create<ModuleDeclaration>(EnclosingDecL, Loc, Name);
+        }
+        ConstantDeclaration *createConstantDeclaration(Decl *EnclosingDecL, SMLoc Loc, IdentifierInfo *Name, Expr *E) {
+            return create<ConstantDeclaration>(EnclosingDecL, Loc, Name, E);
+        }
+        TypeDeclaration *createTypeDeclaration(Decl *EnclosingDecL, SMLoc Loc, IdentifierInfo *Name) {
+            return create<TypeDeclaration>(EnclosingDecL, Loc, Name);
+        }
+        VariableDeclaration *createVariableDeclaration(Decl *EnclosingDecL, SMLoc Loc, IdentifierInfo *Name, TypeDeclaration *Ty) {
+            return create<VariableDeclaration>(EnclosingDecL, Loc, Name, Ty);
+        }
+        FormalParameterDeclaration *createFormalParameterDeclaration(Decl *EnclosingDecL, SMLoc Loc, IdentifierInfo *Name,
+            TypeDeclaration *Ty, bool IsVar) {
+            return create<FormalParameterDeclaration>(EnclosingDecL, Loc, Name, Ty, IsVar);
+        }
+        ProcedureDeclaration *createProcedureDeclaration(Decl *EnclosingDecL, SMLoc Loc, IdentifierInfo *Name) {
+            return create<ProcedureDeclaration>(EnclosingDecL, Loc, Name);
+        }
+
+        // Expressions
+        InfixExpression *createInfixExpression(Expr *Left, Expr *Right, OperatorInfo Op, TypeDeclaration *Ty, bool IsConst) {
+            return create<InfixExpression>(Left, Right, Op, Ty, IsConst);
+        }
+        PrefixExpression *createPrefixExpression(Expr *E, OperatorInfo Op, TypeDeclaration *Ty, bool IsConst) {
+            return create<PrefixExpression>(E, Op, Ty, IsConst);
+        }
+        IntegerLiteral *createIntegerLiteral(SMLoc Loc, llvm::APSInt &&Value, TypeDeclaration *Ty) {
+            return create<IntegerLiteral>(Loc, std::move(Value), Ty);
+        }
+        BooleanLiteral *createBooleanLiteral(bool Value, TypeDeclaration *Ty) {
+            return create<BooleanLiteral>(Value, Ty);
+        }
+        VariableAcccess *createVariableAccess(VariableDeclaration *Var) {
+            return create<VariableAcccess>(Var);
+        }
+        VariableAcccess *createVariableAccess(FormalParameterDeclaration *Param) {
+            return create<VariableAcccess>(Param);
+        }
+        ConstantAccess *createConstantAccess(ConstantDeclaration *Const) {
+            return create<ConstantAccess>(Const);
+        }
+        FunctionCallExpr *createFunctionCallExpr(ProcedureDeclaration *Proc, ArrayRef<Expr *> Params) {
+            return create<FunctionCallExpr>(Proc, Params);
+        }
+
+        // Statements
+        AssignmentStatement *createAssignmentStatement(VariableDeclaration *Var, Expr *E) {
+            return create<AssignmentStatement>(Var, E);
+        }
+        ProcedureCallStatement *createProcedureCallStatement(ProcedureDeclaration *Proc, ArrayRef<Expr *> Params) {
+            return create<ProcedureCallStatement>(Proc, Params);
+        }
+        IfStatement *createIfStatement(Expr *Cond, ArrayRef<Stmt *> IfStmts, ArrayRef<Stmt *> ElseStmts) {
+            return create<IfStatement>(Cond, IfStmts, ElseStmts);
+        }
+        WhileStatement *createWhileStatement(Expr *Cond, ArrayRef<Stmt *> Stmts) {
+            return create<WhileStatement>(Cond, Stmts);
+        }
+        ReturnStatement *createReturnStatement(Expr *RetVal) {
+            return create<ReturnStatement>(RetVal);
+        }
+
+        // Copies a child list collected by the parser into the arena. The
+        // copy lives as long as the nodes referring to it.
+        template<typename T>
+        ArrayRef<T> copyList(const llvm::SmallVectorImpl<T> &List) {
+            if (List.empty()) {
+                return ArrayRef<T>();
+            }
+            static_assert(std::is_trivially_copyable_v<T>, "Child lists hold pointers");
+            ++ListStats.Count;
+            ListStats.Bytes += List.size() * sizeof(T);
+            T *Mem = Allocator.Allocate<T>(List.size());
+            std::uninitialized_copy(List.begin(), List.end(), Mem);
+            return ArrayRef<T>(Mem, List.size());
+        }
+
+        // Number of nodes, the bytes they occupy, and the bytes taken from
+        // the system by the arena, including slack at the end of its slabs
+        unsigned getNumNodes() const { return DeclStats.Count + ExprStats.Count + StmtStats.Count; }
+        size_t getNodeBytes() const { return DeclStats.Bytes + ExprStats.Bytes + StmtStats.Bytes; }
+        size_t getTotalMemory() const { return Allocator.getTotalMemory(); }
+
+        void printStats(raw_ostream &OS) const;
+    };
+
+} // namespace tinylang
+
+#endif
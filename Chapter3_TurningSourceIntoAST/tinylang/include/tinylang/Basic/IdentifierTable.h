@@ -0,0 +1,55 @@
+#ifndef TINYLANG_BASIC_IDENTIFIERTABLE_H
+#define TINYLANG_BASIC_IDENTIFIERTABLE_H
+#include "tinylang/Basic/LLVM.h"
+#include "tinylang/Basic/TokenKinds.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+
+namespace tinylang {
+
+    // The unique entry of an identifier or keyword spelling. The lexer
+    // resolves every spelling to its entry once, so the later phases
+    // compare and hash pointers instead of strings.
+    class IdentifierInfo {
+        friend class IdentifierTable;
+        tok::TokenKind TokenID = tok::identifier;
+        const llvm::StringMapEntry<IdentifierInfo> *Entry = nullptr;
+
+    public:
+        IdentifierInfo() = default;
+        IdentifierInfo(const IdentifierInfo &) = delete;
+        IdentifierInfo &operator=(const IdentifierInfo &) = delete;
+
+        // tok::identifier, or the kind of the keyword with this spelling
+        tok::TokenKind getTokenID() const noexcept { return TokenID; }
+        bool isKeyword() const noexcept { return TokenID != tok::identifier; }
+
+        StringRef getName() const { return Entry->getKey(); }
+        size_t getLength() const { return Entry->getKeyLength(); }
+    };
+
+    // Maps spellings to their IdentifierInfo. The entries are allocated in
+    // an arena and stay at the same address until the table is destroyed.
+    class IdentifierTable {
+        llvm::StringMap<IdentifierInfo, llvm::BumpPtrAllocator> HashTable;
+
+    public:
+        // Creates the entries of all keywords
+        IdentifierTable();
+        IdentifierTable(const IdentifierTable &) = delete;
+        IdentifierTable &operator=(const IdentifierTable &) = delete;
+
+        IdentifierInfo &get(StringRef Name) {
+            auto &Entry = *HashTable.try_emplace(Name).first;
+            IdentifierInfo &II = Entry.getValue();
+            II.Entry = &Entry;
+            return II;
+        }
+
+        unsigned size() const { return HashTable.size(); }
+    };
+
+} // namespace tinylang
+
+#endif
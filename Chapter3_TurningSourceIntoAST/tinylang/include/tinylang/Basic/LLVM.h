@@ -3,6 +3,7 @@
 #include "llvm/Support/Casting.h"
 
 namespace llvm {
+    template<typename T> class ArrayRef;
     class SMLoc;
     class SourceMgr;
     template<typename T, typename A> class StringMap;
@@ -17,6 +18,7 @@ namespace tinylang {
     using llvm::dyn_cast_or_null;
     using llvm::isa;
 
+    using llvm::ArrayRef;
     using llvm::raw_ostream;
     using llvm::SMLoc;
     using llvm::SourceMgr;
@@ -2,30 +2,14 @@
 #define TINYLANG_LEXER_LEXER_H
 
 #include "tinylang/Basic/Diagnostic.h"
+#include "tinylang/Basic/IdentifierTable.h"
 #include "tinylang/Basic/LLVM.h"
 #include "tinylang/Lexer/Token.h"
-#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/SourceMgr.h"
 
 namespace tinylang{
-    class KeywordFilter{
-        llvm::StringMap<tok::TokenKind> HashTable;
-
-        void addKeyword(StringRef Keyword, tok::TokenKind TokenCode);
-
-        public:
-        void addKeywords();
-
-        tok::TokenKind getKeyword(StringRef Name, tok::TokenKind DefaultTokenCode = tok::unknown){
-            if (auto Result = HashTable.find(Name) ; Result != HashTable.end()){
-                return Result->second;
-            }
-            return DefaultTokenCode;
-        }
-    };
-
     class Lexer
     {
     private:
@@ -39,13 +23,14 @@ namespace tinylang{
         /// lexing from as managed by the SrcMgr object
         unsigned CurBuffer = 0;
 
-        KeywordFilter Keywords;
+        /// Idents - Resolves identifiers and keywords to their unique entry
+        IdentifierTable &Idents;
     public:
-        Lexer(SourceMgr &SrcMgr, DiagnosticsEngine &Diags) : SrcMgr(SrcMgr), Diags(Diags){
+        Lexer(SourceMgr &SrcMgr, DiagnosticsEngine &Diags, IdentifierTable &Idents)
+            : SrcMgr(SrcMgr), Diags(Diags), Idents(Idents){
             CurBuffer = SrcMgr.getMainFileID();
             CurBuf = SrcMgr.getMemoryBuffer(CurBuffer)->getBuffer();
             CurPtr = CurBuf.begin();
-            Keywords.addKeywords();
         }
 
         DiagnosticsEngine &getDiagnostics() const noexcept {
@@ -1,5 +1,6 @@
 #ifndef TINYLANG_LEXER_TOKEN_H
 #define TINYLANG_LEXER_TOKEN_H
+#include "tinylang/Basic/IdentifierTable.h"
 #include "tinylang/Basic/LLVM.h"
 #include "tinylang/Basic/TokenKinds.h"
 #include "llvm/Support/SMLoc.h"
@@ -17,6 +18,7 @@ private:
     friend class Lexer;
     const char *Ptr; // Pointer to start of token
     size_t Length;
+    IdentifierInfo *II = nullptr; // Set for identifiers
     tok::TokenKind Kind;
 public:
     tok::TokenKind getKind() const noexcept { return Kind; }
@@ -50,6 +52,11 @@ public:
         return StringRef(Ptr, Length);
     }
 
+    IdentifierInfo *getIdentifierInfo(){
+        assert(is(tok::identifier) && "Cannot get identifier of non-identifier");
+        return II;
+    }
+
     StringRef getLiteralData(){
         assert(isOneOf(tok::integer_literal, tok::string_literal) && "Cannot get literal data of non-literal");
         return StringRef(Ptr, Length);
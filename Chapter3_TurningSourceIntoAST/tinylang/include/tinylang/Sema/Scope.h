@@ -1,24 +1,41 @@
 #ifndef TINYLANG_SEMA_SCOPE_H
 #define TINYLANG_SEMA_SCOPE_H
 #include "tinylang/Basic/LLVM.h"
-#include "llvm/ADT/StringMap.h"
-#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include <utility>
 
 namespace tinylang {
     class Decl;
+    class IdentifierInfo;
 
+    // The symbols of all open scopes in a single table, which maps each name
+    // to its innermost visible declaration. A declaration that hides an
+    // outer one saves the outer binding in an undo log, and leaving a scope
+    // restores the bindings saved since it was entered. A lookup is one
+    // probe however deep the scopes are nested, and entering or leaving a
+    // scope allocates nothing once the table and the log have grown.
     class Scope {
     private:
-        Scope *Parent;
-        StringMap<Decl *> Symbols;
+        struct Binding {
+            Decl *D = nullptr;
+            unsigned Depth = 0; // Of the scope declaring D; 0 if unbound
+        };
+        // Keyed on the unique entry of the name, so a probe hashes a pointer
+        llvm::DenseMap<IdentifierInfo *, Binding> Bindings;
+        llvm::SmallVector<std::pair<IdentifierInfo *, Binding>, 64> UndoLog;
+        llvm::SmallVector<unsigned, 16> ScopeStarts; // UndoLog size when each open scope was entered
 
     public:
-        Scope(Scope *Parent = nullptr) : Parent(Parent) {}
-        bool insert(Decl *Declaration);
-        Decl *lookup(StringRef Name);
+        void enter() { ScopeStarts.push_back(UndoLog.size()); }
+        void leave();
+        // Number of open scopes
+        unsigned getDepth() const noexcept { return ScopeStarts.size(); }
 
-        Scope *getParent() noexcept { return Parent; }
+        // Fails if the innermost scope already declares the name
+        bool insert(Decl *Declaration);
+        Decl *lookup(IdentifierInfo *Name) const;
     };
     
 } // namespace tinylang
-#endif
\ No newline at end of file
+#endif
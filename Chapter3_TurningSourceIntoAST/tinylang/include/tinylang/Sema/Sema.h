@@ -1,6 +1,7 @@
 #ifndef TINYLANG_SEMA_SEMA_H
 #define TINYLANG_SEMA_SEMA_H
 #include "tinylang/AST/AST.h"
+#include "tinylang/AST/ASTContext.h"
 #include "tinylang/Basic/Diagnostic.h"
 #include "tinylang/Sema/Scope.h"
 #include <memory>
@@ -16,11 +17,12 @@ namespace tinylang{
 
         bool isOperatorForType(tok::TokenKind Op, TypeDeclaration *Ty);
 
-        void checkFormalAndActualParameters(SMLoc Loc, const FormalParamList &Formals, const ExprList &Actuals);
+        void checkFormalAndActualParameters(SMLoc Loc, ArrayRef<FormalParameterDeclaration *> Formals, ArrayRef<Expr *> Actuals);
 
-        Scope *CurrentScope;
+        Scope CurrentScope; // Flat over all open scopes
         Decl *CurrentDecl;
         DiagnosticsEngine &Diags;
+        ASTContext &Context; // Owns every node created by the actOn* methods
 
         TypeDeclaration *IntergerType;
         TypeDeclaration *BooleanType;
@@ -30,25 +32,27 @@ namespace tinylang{
         ConstantDeclaration *FalseConst;
 
     public:
-        Sema(DiagnosticsEngine &Diags)
-            : CurrentScope(nullptr), CurrentDecl(nullptr), Diags(Diags) {
+        Sema(DiagnosticsEngine &Diags, ASTContext &Context)
+            : CurrentDecl(nullptr), Diags(Diags), Context(Context) {
             initialize();
         }
 
         void initialize();
-        ModuleDeclaration *actOnModuleDeclaration(SMLoc Loc, StringRef Name);
-        void actOnModuleDeclaration(ModuleDeclaration *ModDecl, SMLoc Loc, StringRef Name, DeclList &Decls, StmtList &Stmts);
-        void actOnImport(StringRef ModuleName, IdentList &Ids);
-        void actOnConstantDeclaration(DeclList &Decls, SMLoc Loc, StringRef Name, Expr *E);
+        ModuleDeclaration *actOnModuleDeclaration(SMLoc Loc, IdentifierInfo *Name);
+        // The methods taking a finished child list by rvalue reference take it
+        // over; the node refers to a copy in the ASTContext.
+        void actOnModuleDeclaration(ModuleDeclaration *ModDecl, SMLoc Loc, IdentifierInfo *Name, DeclList &&Decls, StmtList &&Stmts);
+        void actOnImport(IdentifierInfo *ModuleName, IdentList &Ids);
+        void actOnConstantDeclaration(DeclList &Decls, SMLoc Loc, IdentifierInfo *Name, Expr *E);
         void actOnVariableDeclaration(DeclList &Decls, IdentList &Ids, Decl *D);
         void actOnFormalParameterDeclaration(FormalParamList &Params, IdentList &Ids, Decl *D, bool IsVar);
-        ProcedureDeclaration *actOnProcedureDeclaration(SMLoc Loc, StringRef Name);
-        void actOnProcedureHeading(ProcedureDeclaration *ProcDecl, FormalParamList &Params, Decl *RetType);
-        void actOnProcedureDeclaration(ProcedureDeclaration *ProcDecl, SMLoc Loc, StringRef Name, DeclList &Decls, StmtList &Stmts);
+        ProcedureDeclaration *actOnProcedureDeclaration(SMLoc Loc, IdentifierInfo *Name);
+        void actOnProcedureHeading(ProcedureDeclaration *ProcDecl, FormalParamList &&Params, Decl *RetType);
+        void actOnProcedureDeclaration(ProcedureDeclaration *ProcDecl, SMLoc Loc, IdentifierInfo *Name, DeclList &&Decls, StmtList &&Stmts);
         void actOnAssignment(StmtList &Stmts, SMLoc Loc, Decl *D, Expr *E);
-        void actOnProcCall(StmtList &Stmts, SMLoc Loc, Decl *D, ExprList &Params);
-        void actOnIfStatment(StmtList &Stmts, SMLoc Loc, Expr *Cond, StmtList &IfStmts, StmtList &ElseStmts);
-        void actOnWhileStatement(StmtList &Stmts, SMLoc Loc, Expr *Cond, StmtList &WhileStmts);
+        void actOnProcCall(StmtList &Stmts, SMLoc Loc, Decl *D, ExprList &&Params);
+        void actOnIfStatment(StmtList &Stmts, SMLoc Loc, Expr *Cond, StmtList &&IfStmts, StmtList &&ElseStmts);
+        void actOnWhileStatement(StmtList &Stmts, SMLoc Loc, Expr *Cond, StmtList &&WhileStmts);
         void actOnReturnStatement(StmtList &Stmts, SMLoc Loc, Expr *RetVal);
 
         Expr *actOnExpression(Expr *Left, Expr *Right, const OperatorInfo &Op);
@@ -57,8 +61,8 @@ namespace tinylang{
         Expr *actOnPrefixExpression(Expr *E, const OperatorInfo &Op);
         Expr *actOnIntegerLiteral(SMLoc Loc, StringRef Literal);
         Expr *actOnVariable(Decl *D);
-        Expr *actOnFunctionCall(Decl *D, ExprList &Params);
-        Decl *actOnQualIdentPart(Decl *Prev, SMLoc Loc, StringRef Name);
+        Expr *actOnFunctionCall(Decl *D, ExprList &&Params);
+        Decl *actOnQualIdentPart(Decl *Prev, SMLoc Loc, IdentifierInfo *Name);
     };
 
     class EnterDeclScope {
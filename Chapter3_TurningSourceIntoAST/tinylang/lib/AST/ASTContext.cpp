@@ -0,0 +1,37 @@
+#include "tinylang/AST/ASTContext.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace tinylang;
+
+ASTContext::~ASTContext() {
+    for (auto &[Destroy, Node] : Deallocs) {
+        Destroy(Node);
+    }
+    // The arena frees all of its slabs when Allocator is destroyed
+}
+
+void ASTContext::printStats(raw_ostream &OS) const {
+    auto PrintKind = [&OS](const char *Kind, const NodeStats &Stats) {
+        OS << llvm::format("  %-6s %8u nodes %10zu bytes", Kind, Stats.Count, Stats.Bytes);
+        if (Stats.Count) {
+            OS << llvm::format(" %6.1f bytes/node", double(Stats.Bytes) / Stats.Count);
+        }
+        OS << "\n";
+    };
+
+    OS << "*** AST Context Stats:\n";
+    PrintKind("Decl", DeclStats);
+    PrintKind("Expr", ExprStats);
+    PrintKind("Stmt", StmtStats);
+    unsigned NumNodes = getNumNodes();
+    size_t NodeBytes = getNodeBytes();
+    OS << llvm::format("  Total  %8u nodes %10zu bytes", NumNodes, NodeBytes);
+    if (NumNodes) {
+        OS << llvm::format(" %6.1f bytes/node", double(NodeBytes) / NumNodes);
+    }
+    OS << "\n";
+    OS << "  Lists: " << ListStats.Count << " non-empty child lists, " << ListStats.Bytes << " bytes\n";
+    OS << "  Arena: " << getTotalMemory() << " bytes in " << Allocator.GetNumSlabs() << " slabs, "
+       << Deallocs.size() << " nodes with destructors\n";
+}
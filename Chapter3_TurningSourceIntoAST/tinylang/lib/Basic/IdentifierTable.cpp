@@ -0,0 +1,9 @@
+#include "tinylang/Basic/IdentifierTable.h"
+
+using namespace tinylang;
+
+IdentifierTable::IdentifierTable() {
+    #define KEYWORD(NAME, FLAGS) \
+    get(StringRef(#NAME)).TokenID = tok::kw_##NAME;
+    #include "tinylang/Basic/TokenKinds.def"
+}
@@ -1,16 +1,15 @@
 #include "tinylang/Lexer/Lexer.h"
+#include "llvm/Support/MathExtras.h"
+#include <cstddef>
+#include <cstdint>
 
-using namespace tinylang;
-
-void KeywordFilter::addKeyword(StringRef Keyword, tok::TokenKind TokenCode){
-    HashTable.insert(std::make_pair(Keyword, TokenCode));
-}
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-void KeywordFilter::addKeywords(){
-    #define KEYWORD(NAME, FLAGS) \
-    addKeyword(StringRef(#NAME), tok::kw_##NAME);
-    #include "tinylang/Basic/TokenKinds.def"
-}
+using namespace tinylang;
 
 namespace charinfo{
     LLVM_READNONE inline bool isASCII(char Ch){
@@ -46,10 +45,133 @@ namespace charinfo{
     }
 } // namespace charinfo
 
+// Finds the end of a run of characters of one class, or the next character
+// of a class. With SSE2 or AVX2, 16 or 32 bytes are classified at once,
+// and each vector predicate must accept exactly the characters of its
+// charinfo counterpart. A block is only loaded while it ends before the
+// buffer does; the bytes after that are scanned one at a time, and the
+// terminating NUL of the buffer stops the scalar loops.
+namespace scan{
+#if defined(__AVX2__)
+    using Vec = __m256i;
+    constexpr unsigned Width = 32;
+    inline Vec load(const char *Ptr) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Ptr)); }
+    inline Vec splat(char Ch) { return _mm256_set1_epi8(Ch); }
+    inline Vec eq(Vec V, char Ch) { return _mm256_cmpeq_epi8(V, splat(Ch)); }
+    inline Vec either(Vec A, Vec B) { return _mm256_or_si256(A, B); }
+    inline Vec andNot(Vec A, Vec B) { return _mm256_andnot_si256(B, A); }
+    // The comparison is signed, so non-ASCII bytes are never in range
+    inline Vec inRange(Vec V, char Lo, char Hi) {
+        return _mm256_and_si256(_mm256_cmpgt_epi8(V, splat(Lo - 1)), _mm256_cmpgt_epi8(splat(Hi + 1), V));
+    }
+    inline uint32_t mask(Vec V) { return static_cast<uint32_t>(_mm256_movemask_epi8(V)); }
+#define TINYLANG_LEXER_SIMD
+#elif defined(__SSE2__)
+    using Vec = __m128i;
+    constexpr unsigned Width = 16;
+    inline Vec load(const char *Ptr) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(Ptr)); }
+    inline Vec splat(char Ch) { return _mm_set1_epi8(Ch); }
+    inline Vec eq(Vec V, char Ch) { return _mm_cmpeq_epi8(V, splat(Ch)); }
+    inline Vec either(Vec A, Vec B) { return _mm_or_si128(A, B); }
+    inline Vec andNot(Vec A, Vec B) { return _mm_andnot_si128(B, A); }
+    // The comparison is signed, so non-ASCII bytes are never in range
+    inline Vec inRange(Vec V, char Lo, char Hi) {
+        return _mm_and_si128(_mm_cmpgt_epi8(V, splat(Lo - 1)), _mm_cmplt_epi8(V, splat(Hi + 1)));
+    }
+    inline uint32_t mask(Vec V) { return static_cast<uint32_t>(_mm_movemask_epi8(V)); }
+#define TINYLANG_LEXER_SIMD
+#endif
+
+#ifdef TINYLANG_LEXER_SIMD
+    template<typename... Vecs>
+    inline Vec either(Vec A, Vec B, Vecs... Rest) { return either(either(A, B), Rest...); }
+
+    constexpr uint32_t AllSet = Width == 32 ? ~uint32_t(0) : (uint32_t(1) << Width) - 1;
+#endif
+
+    // Character classes; block() has one mask bit per byte of the block
+    struct IdentifierBody {
+#ifdef TINYLANG_LEXER_SIMD
+        uint32_t block(Vec V) const {
+            return mask(either(inRange(V, 'a', 'z'), inRange(V, 'A', 'Z'), inRange(V, '0', '9'), eq(V, '_')));
+        }
+#endif
+        bool operator()(char Ch) const { return charinfo::isIdentifierBody(Ch); }
+    };
+
+    struct Whitespace {
+#ifdef TINYLANG_LEXER_SIMD
+        // '\t', '\v', '\f', '\r' or a space, but not '\n'
+        uint32_t block(Vec V) const {
+            return mask(either(andNot(inRange(V, '\t', '\r'), eq(V, '\n')), eq(V, ' ')));
+        }
+#endif
+        bool operator()(char Ch) const { return charinfo::isWhitespace(Ch); }
+    };
+
+    struct CommentDelimiter {
+#ifdef TINYLANG_LEXER_SIMD
+        uint32_t block(Vec V) const { return mask(either(eq(V, '('), eq(V, '*'), eq(V, '\0'))); }
+#endif
+        // Not short-circuited, which would make the compiler branch on the
+        // class of each byte of the comment text
+        bool operator()(char Ch) const { return (Ch == '(') | (Ch == '*') | (Ch == '\0'); }
+    };
+
+    struct StringEnd {
+        char Quote;
+#ifdef TINYLANG_LEXER_SIMD
+        uint32_t block(Vec V) const { return mask(either(eq(V, Quote), eq(V, '\0'), eq(V, '\r'), eq(V, '\t'))); }
+#endif
+        // The vertical whitespace of charinfo, spelled out without branches
+        bool operator()(char Ch) const {
+            return (Ch == Quote) | (Ch == '\0') | (Ch == '\r') | (Ch == '\t');
+        }
+    };
+
+    // Returns the first character at or after Ptr not in Class
+    template<typename CharClass>
+    inline const char *skipWhile(const char *Ptr, const char *BufEnd, CharClass Class) {
+#ifdef TINYLANG_LEXER_SIMD
+        while (BufEnd - Ptr >= static_cast<ptrdiff_t>(Width)) {
+            uint32_t Mask = Class.block(load(Ptr));
+            if (Mask != AllSet) {
+                return Ptr + llvm::countTrailingZeros(~Mask & AllSet);
+            }
+            Ptr += Width;
+        }
+#endif
+        while (Class(*Ptr)) {
+            ++Ptr;
+        }
+        return Ptr;
+    }
+
+    // Returns the first character at or after Ptr in Class
+    template<typename CharClass>
+    inline const char *skipUntil(const char *Ptr, const char *BufEnd, CharClass Class) {
+#ifdef TINYLANG_LEXER_SIMD
+        while (BufEnd - Ptr >= static_cast<ptrdiff_t>(Width)) {
+            if (uint32_t Mask = Class.block(load(Ptr))) {
+                return Ptr + llvm::countTrailingZeros(Mask);
+            }
+            Ptr += Width;
+        }
+#endif
+        while (!Class(*Ptr)) {
+            ++Ptr;
+        }
+        return Ptr;
+    }
+} // namespace scan
+
 void Lexer::next(Token &Result){
-    // Skip whitespace
-    while (*CurPtr && charinfo::isWhitespace(*CurPtr)){
+    // Skip whitespace. Most runs are a single space, which needs no block.
+    if (charinfo::isWhitespace(*CurPtr)){
         ++CurPtr;
+        if (charinfo::isWhitespace(*CurPtr)){
+            CurPtr = scan::skipWhile(CurPtr, CurBuf.end(), scan::Whitespace());
+        }
     }
 
     if(!*CurPtr){
@@ -122,12 +244,12 @@ void Lexer::next(Token &Result){
     
 void Lexer::identifier(Token &Result){
     const char *Start = CurPtr;
-    const char *End = CurPtr + 1;
-    while (charinfo::isIdentifierBody(*End)){
-        ++End;
-    }
+    const char *End = scan::skipWhile(CurPtr + 1, CurBuf.end(), scan::IdentifierBody());
     StringRef Name(Start, End - Start);
-    formToken(Result, End, Keywords.getKeyword(Name, tok::identifier));
+    // The only hash of the spelling; keywords are entries with a keyword kind
+    IdentifierInfo &II = Idents.get(Name);
+    formToken(Result, End, II.getTokenID());
+    Result.II = II.isKeyword() ? nullptr : &II;
 }
 
 void Lexer::number(Token &Result){
@@ -163,10 +285,7 @@ void Lexer::number(Token &Result){
 
 void Lexer::string(Token &Result){
     const char *Start = CurPtr;
-    const char *End = CurPtr + 1;
-    while (*End && *End != *Start && !charinfo::isVerticalWhitespace(*End)){
-        ++End;
-    }
+    const char *End = scan::skipUntil(CurPtr + 1, CurBuf.end(), scan::StringEnd{*Start});
     if (charinfo::isVerticalWhitespace(*End)){
         Diags.report(getLoc(), diag::err_unterminated_char_or_string);
     }
@@ -176,7 +295,12 @@ void Lexer::string(Token &Result){
 void Lexer::comment(){
     const char *End = CurPtr + 2;
     unsigned Level = 1;
-    while (*End && Level){
+    while (Level){
+        // Only the delimiters of nested comments matter
+        End = scan::skipUntil(End, CurBuf.end(), scan::CommentDelimiter());
+        if (!*End){
+            break;
+        }
         // Check for nested comment
         if(*End == '(' && *(End + 1) == '*'){
             End += 2;
@@ -201,6 +325,7 @@ void Lexer::formToken(Token &Result, const char *TokEnd, tok::TokenKind Kind){
     Result.Ptr = CurPtr;
     Result.Length = TokLen;
     Result.Kind = Kind;
+    Result.II = nullptr;
     CurPtr = TokEnd;
 }
 
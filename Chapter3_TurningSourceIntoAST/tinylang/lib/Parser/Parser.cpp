@@ -28,7 +28,7 @@ bool Parser::parseCompilationUnit(ModuleDeclaration *&D) {
     if (expect(tok::identifier)){
         return _errorhandler();
     }
-    D = Actions.actOnModuleDeclaration(Tok.getLocation(), Tok.getIdentifier());
+    D = Actions.actOnModuleDeclaration(Tok.getLocation(), Tok.getIdentifierInfo());
 
     EnterDeclScope S(Actions, D);
     advance();
@@ -48,7 +48,7 @@ bool Parser::parseCompilationUnit(ModuleDeclaration *&D) {
     if (expect(tok::identifier)){
         return _errorhandler();
     }
-    Actions.actOnModuleDeclaration(D, Tok.getLocation(), Tok.getIdentifier(), Decls, Stmts);
+    Actions.actOnModuleDeclaration(D, Tok.getLocation(), Tok.getIdentifierInfo(), std::move(Decls), std::move(Stmts));
     advance();
     if (consume(tok::period)){
         return _errorhandler();
@@ -62,13 +62,13 @@ bool Parser::parseImport() {
         return skipUntil(tok::kw_BEGIN, tok::kw_CONST, tok::kw_END, tok::kw_FROM, tok::kw_IMPORT, tok::kw_PROCEDURE, tok::kw_VAR);
     };
     IdentList Ids;
-    StringRef ModuleName;
+    IdentifierInfo *ModuleName = nullptr;
     if (Tok.is(tok::kw_FROM)) {
         advance();
         if (expect(tok::identifier)) {
             return _errorhandler();
         }
-        ModuleName = Tok.getIdentifier();
+        ModuleName = Tok.getIdentifierInfo();
         advance();
     }
     if (consume(tok::kw_IMPORT)) {
@@ -155,7 +155,7 @@ bool Parser::parseConstantDeclaration(DeclList &Decls) {
     }
     SMLoc Loc = Tok.getLocation();
 
-    StringRef Name = Tok.getName();
+    IdentifierInfo *Name = Tok.getIdentifierInfo();
     advance();
     if (expect(tok::equal)) {
         return _errorhandler();
@@ -198,7 +198,7 @@ bool Parser::parseProcedureDeclaration(DeclList &ParentDecls) {
     if (expect(tok::identifier)) {
         return _errorhandler();
     }
-    ProcedureDeclaration *D = Actions.actOnProcedureDeclaration(Tok.getLocation(), Tok.getIdentifier());
+    ProcedureDeclaration *D = Actions.actOnProcedureDeclaration(Tok.getLocation(), Tok.getIdentifierInfo());
     EnterDeclScope S(Actions, D);
     FormalParamList Params;
     Decl *RetType = nullptr;
@@ -208,7 +208,7 @@ bool Parser::parseProcedureDeclaration(DeclList &ParentDecls) {
             return _errorhandler();
         }
     }
-    Actions.actOnProcedureHeading(D, Params, RetType);
+    Actions.actOnProcedureHeading(D, std::move(Params), RetType);
     if (expect(tok::semi)) {
         return _errorhandler();
     }
@@ -221,7 +221,7 @@ bool Parser::parseProcedureDeclaration(DeclList &ParentDecls) {
     if (expect(tok::identifier)) {
         return _errorhandler();
     }
-    Actions.actOnProcedureDeclaration(D, Tok.getLocation(), Tok.getIdentifier(), Decls, Stmts);
+    Actions.actOnProcedureDeclaration(D, Tok.getLocation(), Tok.getIdentifierInfo(), std::move(Decls), std::move(Stmts));
     ParentDecls.push_back(D);
     advance();
     return false;
@@ -332,7 +332,7 @@ bool Parser::parseStatement(StmtList &Stmts) {
                     return _errorhandler();
                 }
             }
-            Actions.actOnProcCall(Stmts, Loc, D, Exprs);
+            Actions.actOnProcCall(Stmts, Loc, D, std::move(Exprs));
         }
     } else if (Tok.is(tok::kw_IF)) {
         if (parseIfStatement(Stmts)) {
@@ -381,7 +381,7 @@ bool Parser::parseIfStatement(StmtList &Stmts) {
     if (expect(tok::kw_END)) {
         return _errorhandler();
     }
-    Actions.actOnIfStatment(Stmts, Loc, E, IfStmts, ElseStmts);
+    Actions.actOnIfStatment(Stmts, Loc, E, std::move(IfStmts), std::move(ElseStmts));
     advance();
     return false;
 }
@@ -408,7 +408,7 @@ bool Parser::parseWhileStatement(StmtList &Stmts) {
     if (expect(tok::kw_END)) {
         return _errorhandler();
     }
-    Actions.actOnWhileStatement(Stmts, Loc, E, WhileStmts);
+    Actions.actOnWhileStatement(Stmts, Loc, E, std::move(WhileStmts));
     advance();
     return false;
 }
@@ -616,7 +616,7 @@ bool Parser::parseFactor(Expr *&E) {
             if(expect(tok::r_paren)) {
                 return _errorhandler();
             }
-            E = Actions.actOnFunctionCall(D, Exprs);
+            E = Actions.actOnFunctionCall(D, std::move(Exprs));
             advance();
         }
         else if (Tok.isOneOf(tok::hash, tok::r_paren, tok::star,
@@ -665,14 +665,14 @@ bool Parser::parseQualident(Decl *&D) {
     if (expect(tok::identifier)) {
         return _errorhandler();
     }
-    D = Actions.actOnQualIdentPart(D, Tok.getLocation(), Tok.getIdentifier());
+    D = Actions.actOnQualIdentPart(D, Tok.getLocation(), Tok.getIdentifierInfo());
     advance(); // Move to the next token, could potentially be a dot (.)
     while (Tok.is(tok::period) && isa<ModuleDeclaration>(D)) {
         advance(); // Move to the identifier token after a dot.
         if (expect(tok::identifier)) {
             return _errorhandler();
         }
-        D = Actions.actOnQualIdentPart(D, Tok.getLocation(), Tok.getName());
+        D = Actions.actOnQualIdentPart(D, Tok.getLocation(), Tok.getIdentifierInfo());
         advance(); // Move to the next token, could potentially be a dot (.)
     }
     return false;
@@ -685,14 +685,14 @@ bool Parser::parseIdentList(IdentList &Ids) {
     if (expect(tok::identifier)) {
         return _errorhandler();
     }
-    Ids.push_back(std::pair<SMLoc, StringRef>(Tok.getLocation(), Tok.getIdentifier()));
+    Ids.push_back(std::pair<SMLoc, IdentifierInfo *>(Tok.getLocation(), Tok.getIdentifierInfo()));
     advance();
     while (Tok.is(tok::comma)) {
         advance(); // Move to the identifier token after a comma.
         if (expect(tok::identifier)) {
             return _errorhandler();
         }
-        Ids.push_back(std::pair<SMLoc, StringRef>(Tok.getLocation(), Tok.getIdentifier()));
+        Ids.push_back(std::pair<SMLoc, IdentifierInfo *>(Tok.getLocation(), Tok.getIdentifierInfo()));
         advance(); // Move to the next token, could potentially be a comma (,)
     }
     return false;
@@ -3,23 +3,29 @@
 
 using namespace tinylang;
 
-bool Scope::insert(Decl *Declaration) {
-      /// insert - Inserts the specified key/value pair into the map if the key
-      /// isn't already in the map. The bool component of the returned pair is true
-     /// if and only if the insertion takes place, and the iterator component of
-    /// the pair points to the element with key equivalent to the key of the pair
-    return Symbols.insert(std::pair<StringRef, Decl *>(Declaration->getName(), Declaration)).second;
+void Scope::leave() {
+    assert(!ScopeStarts.empty() && "Can't leave non-existing scope");
+    unsigned Start = ScopeStarts.pop_back_val();
+    // Restore the bindings hidden by this scope, latest first
+    while (UndoLog.size() > Start) {
+        auto [Name, Outer] = UndoLog.pop_back_val();
+        Bindings[Name] = Outer;
+    }
 }
 
-Decl *Scope::lookup(StringRef Name) {
-    Scope *CurScope = this;
-
-    while (CurScope) {
-        StringMap<Decl *>::const_iterator It = CurScope->Symbols.find(Name);
-        if(It != CurScope->Symbols.end()){
-            return It->second;
-        }
-        CurScope = CurScope->getParent();
+bool Scope::insert(Decl *Declaration) {
+    assert(!ScopeStarts.empty() && "No scope entered");
+    unsigned Depth = getDepth();
+    Binding &B = Bindings[Declaration->getIdentifier()];
+    if (B.Depth == Depth) {
+        return false;
     }
-    return nullptr;
-}
\ No newline at end of file
+    UndoLog.push_back({Declaration->getIdentifier(), B});
+    B = Binding{Declaration, Depth};
+    return true;
+}
+
+Decl *Scope::lookup(IdentifierInfo *Name) const {
+    auto It = Bindings.find(Name);
+    return It != Bindings.end() ? It->second.D : nullptr;
+}
@@ -4,15 +4,12 @@
 using namespace tinylang;
 
 void Sema::enterScope(Decl *D) {
-    CurrentScope = new Scope(CurrentScope);
+    CurrentScope.enter();
     CurrentDecl = D;
 }
 
 void Sema::leaveScope(){
-    assert(CurrentScope && "Can't leave non-existing scope");
-    Scope *Parent = CurrentScope->getParent();
-    delete CurrentScope;
-    CurrentScope = Parent;
+    CurrentScope.leave();
     CurrentDecl = CurrentDecl->getEnclosingDecl();
 }
 
@@ -40,7 +37,7 @@ bool Sema::isOperatorForType(tok::TokenKind Op, TypeDeclaration *Ty){
     }
 }
 
-void Sema::checkFormalAndActualParameters(SMLoc Loc, const FormalParamList &Formals, const ExprList &Actuals){
+void Sema::checkFormalAndActualParameters(SMLoc Loc, ArrayRef<FormalParameterDeclaration *> Formals, ArrayRef<Expr *> Actuals){
     // Number of parameters and arguments must match
     if(Formals.size() != Actuals.size()) {
         Diags.report(Loc, diag::err_wrong_number_of_parameters);
@@ -63,59 +60,60 @@ void Sema::checkFormalAndActualParameters(SMLoc Loc, const FormalParamList &Form
 
 void Sema::initialize(){
     // Setup global scope
-    CurrentScope = new Scope();
+    CurrentScope.enter();
     CurrentDecl = nullptr;
-    IntergerType = new TypeDeclaration(CurrentDecl, SMLoc(), "INTEGER");
-    BooleanType = new TypeDeclaration(CurrentDecl, SMLoc(), "BOOLEAN");
-    TrueLiteral = new BooleanLiteral(true, BooleanType);
-    FalseLiteral = new BooleanLiteral(false, BooleanType);
-    TrueConst = new ConstantDeclaration(CurrentDecl, SMLoc(), "TRUE", TrueLiteral);
-    FalseConst = new ConstantDeclaration(CurrentDecl, SMLoc(), "FALSE", FalseLiteral);
-    CurrentScope->insert(IntergerType);
-    CurrentScope->insert(BooleanType);
-    CurrentScope->insert(TrueConst);
-    CurrentScope->insert(FalseConst);
+    IdentifierTable &Idents = Context.getIdentifierTable();
+    IntergerType = Context.createTypeDeclaration(CurrentDecl, SMLoc(), &Idents.get("INTEGER"));
+    BooleanType = Context.createTypeDeclaration(CurrentDecl, SMLoc(), &Idents.get("BOOLEAN"));
+    TrueLiteral = Context.createBooleanLiteral(true, BooleanType);
+    FalseLiteral = Context.createBooleanLiteral(false, BooleanType);
+    TrueConst = Context.createConstantDeclaration(CurrentDecl, SMLoc(), &Idents.get("TRUE"), TrueLiteral);
+    FalseConst = Context.createConstantDeclaration(CurrentDecl, SMLoc(), &Idents.get("FALSE"), FalseLiteral);
+    CurrentScope.insert(IntergerType);
+    CurrentScope.insert(BooleanType);
+    CurrentScope.insert(TrueConst);
+    CurrentScope.insert(FalseConst);
 }
 
-ModuleDeclaration *Sema::actOnModuleDeclaration(SMLoc Loc, StringRef Name){
-    return new ModuleDeclaration(CurrentDecl, Loc, Name);
+ModuleDeclaration *Sema::actOnModuleDeclaration(SMLoc Loc, IdentifierInfo *Name){
+    return Context.createModuleDeclaration(CurrentDecl, Loc, Name);
 }
 
-void Sema::actOnModuleDeclaration(ModuleDeclaration *ModDecl, SMLoc Loc, StringRef Name, DeclList &Decls, StmtList &Stmts) {
-    if (Name != ModDecl->getName()) {
+void Sema::actOnModuleDeclaration(ModuleDeclaration *ModDecl, SMLoc Loc, IdentifierInfo *Name, DeclList &&Decls, StmtList &&Stmts) {
+    if (Name != ModDecl->getIdentifier()) {
         Diags.report(Loc, diag::err_module_identifier_not_equal);
         Diags.report(ModDecl->getLocation(), diag::note_module_identifier_declaration);
     }
-    ModDecl->setDecls(Decls);
-    ModDecl->setStmts(Stmts);
+    ModDecl->setDecls(Context.copyList(Decls));
+    ModDecl->setStmts(Context.copyList(Stmts));
 }
 
-void Sema::actOnImport(StringRef ModuleName, IdentList &Ids){
+void Sema::actOnImport(IdentifierInfo *ModuleName, IdentList &Ids){
     Diags.report(SMLoc(), diag::err_not_yet_implemented);
 }
 
-void Sema::actOnConstantDeclaration(DeclList &Decls, SMLoc Loc, StringRef Name, Expr *E){
-    assert(CurrentScope && "CurrentScope not set");
-    ConstantDeclaration *Decl = new ConstantDeclaration(CurrentDecl, Loc, Name, E);
+void Sema::actOnConstantDeclaration(DeclList &Decls, SMLoc Loc, IdentifierInfo *Name, Expr *E){
+    assert(CurrentScope.getDepth() && "CurrentScope not set");
+    ConstantDeclaration *Decl = Context.createConstantDeclaration(CurrentDecl, Loc, Name, E);
     // Only one constant of the same name can exist in the current scop
-    if(CurrentScope->insert(Decl)){
+    if(CurrentScope.insert(Decl)){
         Decls.push_back(Decl);
     } else {
-        Diags.report(Loc, diag::err_symbold_declared, Name);
+        Diags.report(Loc, diag::err_symbold_declared, Name->getName());
     }
 }
 
 void Sema::actOnVariableDeclaration(DeclList &Decls, IdentList &Ids, Decl *D){
-    assert(CurrentScope && "CurrentScope not set");
+    assert(CurrentScope.getDepth() && "CurrentScope not set");
     // A type must be supplied for a variable or list of variables
     if(TypeDeclaration *Ty = dyn_cast<TypeDeclaration>(D)){
         for(auto &[Loc, Name] : Ids){
-            auto *Decl = new VariableDeclaration(CurrentDecl, Loc, Name, Ty);
+            auto *Decl = Context.createVariableDeclaration(CurrentDecl, Loc, Name, Ty);
             // Only one variable of the same name should exist in the current scope.
-            if(CurrentScope->insert(Decl)){
+            if(CurrentScope.insert(Decl)){
                 Decls.push_back(Decl);
             } else {
-                Diags.report(Loc, diag::err_symbold_declared, Name);
+                Diags.report(Loc, diag::err_symbold_declared, Name->getName());
             }
         }
     } else if (!Ids.empty()) {
@@ -126,16 +124,16 @@ void Sema::actOnVariableDeclaration(DeclList &Decls, IdentList &Ids, Decl *D){
 }
 
 void Sema::actOnFormalParameterDeclaration(FormalParamList &Params, IdentList &Ids, Decl *D, bool IsVar){
-    assert(CurrentScope && "CurrentScope not set");
+    assert(CurrentScope.getDepth() && "CurrentScope not set");
     // A type must be supplied for a formal parameter
     if (TypeDeclaration *Ty = dyn_cast<TypeDeclaration>(D)){
         for(auto &[Loc, Name] : Ids){
-            FormalParameterDeclaration *Decl = new FormalParameterDeclaration(CurrentDecl, Loc, Name, Ty, IsVar);
+            FormalParameterDeclaration *Decl = Context.createFormalParameterDeclaration(CurrentDecl, Loc, Name, Ty, IsVar);
             // A formal parameter should be declared only once in the current scope
-            if(CurrentScope->insert(Decl)){
+            if(CurrentScope.insert(Decl)){
                 Params.push_back(Decl);
             } else {
-                Diags.report(Loc, diag::err_symbold_declared, Name);
+                Diags.report(Loc, diag::err_symbold_declared, Name->getName());
             }
         }
     } else if (!Ids.empty()){
@@ -144,16 +142,16 @@ void Sema::actOnFormalParameterDeclaration(FormalParamList &Params, IdentList &I
     }
 }
 
-ProcedureDeclaration *Sema::actOnProcedureDeclaration(SMLoc Loc, StringRef Name){
-    ProcedureDeclaration *P = new ProcedureDeclaration(CurrentDecl, Loc, Name);
+ProcedureDeclaration *Sema::actOnProcedureDeclaration(SMLoc Loc, IdentifierInfo *Name){
+    ProcedureDeclaration *P = Context.createProcedureDeclaration(CurrentDecl, Loc, Name);
     // Procedure should be declared only once in the current scope
-    if (!CurrentScope->insert(P))
-        Diags.report(Loc, diag::err_symbold_declared, Name);
+    if (!CurrentScope.insert(P))
+        Diags.report(Loc, diag::err_symbold_declared, Name->getName());
     return P;
 }
 
-void Sema::actOnProcedureHeading(ProcedureDeclaration *ProcDecl, FormalParamList &Params, Decl *RetType){
-    ProcDecl->setFormalParams(Params);
+void Sema::actOnProcedureHeading(ProcedureDeclaration *ProcDecl, FormalParamList &&Params, Decl *RetType){
+    ProcDecl->setFormalParams(Context.copyList(Params));
     auto *RetTypeDecl = dyn_cast_or_null<TypeDeclaration>(RetType);
     // Return type of a procedure must be a type
     if(!RetTypeDecl && RetType){
@@ -163,13 +161,13 @@ void Sema::actOnProcedureHeading(ProcedureDeclaration *ProcDecl, FormalParamList
     }
 }
 
-void Sema::actOnProcedureDeclaration(ProcedureDeclaration *ProcDecl, SMLoc Loc, StringRef Name, DeclList &Decls, StmtList &Stmts){
-    if (Name != ProcDecl->getName()){
+void Sema::actOnProcedureDeclaration(ProcedureDeclaration *ProcDecl, SMLoc Loc, IdentifierInfo *Name, DeclList &&Decls, StmtList &&Stmts){
+    if (Name != ProcDecl->getIdentifier()){
         Diags.report(Loc, diag::err_proc_identifier_not_equal);
         Diags.report(ProcDecl->getLocation(), diag::note_proc_identifier_declaration);
     }
-    ProcDecl->setDecls(Decls);
-    ProcDecl->setStmts(Stmts);
+    ProcDecl->setDecls(Context.copyList(Decls));
+    ProcDecl->setStmts(Context.copyList(Stmts));
 }
 
 void Sema::actOnAssignment(StmtList &Stmts, SMLoc Loc, Decl *D, Expr *E){
@@ -177,25 +175,25 @@ void Sema::actOnAssignment(StmtList &Stmts, SMLoc Loc, Decl *D, Expr *E){
         if(Var->getType() != E->getType()){
             Diags.report(Loc, diag::err_types_for_operator_not_compatible, tok::getPunctuatorSpelling(tok::colonequal));
         }
-        Stmts.push_back(new AssignmentStatement(Var, E));
+        Stmts.push_back(Context.createAssignmentStatement(Var, E));
     } else if (D) {
         // TODO: Emit error
     }
 }
 
-void Sema::actOnProcCall(StmtList &Stmts, SMLoc Loc, Decl *D, ExprList &Params){
+void Sema::actOnProcCall(StmtList &Stmts, SMLoc Loc, Decl *D, ExprList &&Params){
     if (auto Proc = dyn_cast<ProcedureDeclaration>(D)){
         checkFormalAndActualParameters(Loc, Proc->getFormalParams(), Params);
         if (Proc->getReturnType()) {
             Diags.report(Loc, diag::err_procedure_call_on_nonprocedure);
         }
-        Stmts.push_back(new ProcedureCallStatement(Proc, Params));
+        Stmts.push_back(Context.createProcedureCallStatement(Proc, Context.copyList(Params)));
     } else if (D) {
         Diags.report(Loc, diag::err_procedure_call_on_nonprocedure);
     } 
 }
 
-void Sema::actOnIfStatment(StmtList &Stmts, SMLoc Loc, Expr *Cond, StmtList &IfStmts, StmtList &ElseStmts) {
+void Sema::actOnIfStatment(StmtList &Stmts, SMLoc Loc, Expr *Cond, StmtList &&IfStmts, StmtList &&ElseStmts) {
     if(!Cond) {
         Cond = FalseLiteral;
     }
@@ -203,11 +201,11 @@ void Sema::actOnIfStatment(StmtList &Stmts, SMLoc Loc, Expr *Cond, StmtList &IfS
     if(Cond->getType() != BooleanType) {
         Diags.report(Loc, diag::err_if_expr_must_be_bool);
     }
-    Stmts.push_back(new IfStatement(Cond, IfStmts, ElseStmts));
+    Stmts.push_back(Context.createIfStatement(Cond, Context.copyList(IfStmts), Context.copyList(ElseStmts)));
 }
 
 
-void Sema::actOnWhileStatement(StmtList &Stmts, SMLoc Loc, Expr *Cond, StmtList &WhileStmts) {
+void Sema::actOnWhileStatement(StmtList &Stmts, SMLoc Loc, Expr *Cond, StmtList &&WhileStmts) {
     if(!Cond) {
         Cond = FalseLiteral;
     }
@@ -215,7 +213,7 @@ void Sema::actOnWhileStatement(StmtList &Stmts, SMLoc Loc, Expr *Cond, StmtList
     if (Cond->getType() != BooleanType) {
         Diags.report(Loc, diag::err_while_expr_must_be_bool);
     }
-    Stmts.push_back(new WhileStatement(Cond, WhileStmts));
+    Stmts.push_back(Context.createWhileStatement(Cond, Context.copyList(WhileStmts)));
 }
 
 void Sema::actOnReturnStatement(StmtList &Stmts, SMLoc Loc, Expr *RetVal) {
@@ -229,7 +227,7 @@ void Sema::actOnReturnStatement(StmtList &Stmts, SMLoc Loc, Expr *RetVal) {
             Diags.report(Loc, diag::err_function_and_return_type);
         }
     }
-    Stmts.push_back(new ReturnStatement(RetVal));
+    Stmts.push_back(Context.createReturnStatement(RetVal));
 }
 
 Expr *Sema::actOnExpression(Expr *Left, Expr *Right, const OperatorInfo &Op) {
@@ -243,7 +241,7 @@ Expr *Sema::actOnExpression(Expr *Left, Expr *Right, const OperatorInfo &Op) {
         Diags.report(Op.getLocation(), diag::err_types_for_operator_not_compatible, tok::getPunctuatorSpelling(Op.getKind()));
     }
     bool IsConst = Left->isConst() && Right->isConst();
-    return new InfixExpression(Left, Right, Op, BooleanType, IsConst);
+    return Context.createInfixExpression(Left, Right, Op, BooleanType, IsConst);
 }
 
 Expr *Sema::actOnSimpleExpression(Expr *Left, Expr *Right, const OperatorInfo &Op) {
@@ -264,7 +262,7 @@ Expr *Sema::actOnSimpleExpression(Expr *Left, Expr *Right, const OperatorInfo &O
         BooleanLiteral *R = dyn_cast<BooleanLiteral>(Right);
         return (L->getValue() || R->getValue()) ? TrueLiteral : FalseLiteral;
     }
-    return new InfixExpression(Left, Right, Op, Ty, IsConst);
+    return Context.createInfixExpression(Left, Right, Op, Ty, IsConst);
 }
 
 Expr *Sema::actOnTerm(Expr *Left, Expr *Right, const OperatorInfo &Op) {
@@ -284,7 +282,7 @@ Expr *Sema::actOnTerm(Expr *Left, Expr *Right, const OperatorInfo &Op) {
         BooleanLiteral *R = dyn_cast<BooleanLiteral>(Right);
         return (L->getValue() && R->getValue()) ? TrueLiteral : FalseLiteral;
     }
-    return new InfixExpression(Left, Right, Op, Ty, IsConst);
+    return Context.createInfixExpression(Left, Right, Op, Ty, IsConst);
 }
 
 Expr *Sema::actOnPrefixExpression(Expr *E, const OperatorInfo &Op) {
@@ -313,7 +311,7 @@ Expr *Sema::actOnPrefixExpression(Expr *E, const OperatorInfo &Op) {
             Diags.report(Op.getLocation(), diag::warn_ambigous_negation);
         }
     }
-    return new PrefixExpression(E, Op, E->getType(), E->isConst());
+    return Context.createPrefixExpression(E, Op, E->getType(), E->isConst());
 }
 
 Expr *Sema::actOnIntegerLiteral(SMLoc Loc, StringRef Literal) {
@@ -336,7 +334,7 @@ Expr *Sema::actOnIntegerLiteral(SMLoc Loc, StringRef Literal) {
     /// \param radix the radix to use for the conversion
     /// APInt(unsigned numBits, StringRef str, uint8_t radix);
     llvm::APInt Value(64,Literal, Radix);
-    return new IntegerLiteral(Loc, llvm::APSInt(Value, false), IntergerType); // APSInt - An arbitrary precision integer that knows its signedness.
+    return Context.createIntegerLiteral(Loc, llvm::APSInt(Value, false), IntergerType); // APSInt - An arbitrary precision integer that knows its signedness.
 }
 
 Expr *Sema::actOnVariable(Decl *D) {
@@ -344,9 +342,9 @@ Expr *Sema::actOnVariable(Decl *D) {
         return nullptr;
     }
     if (auto *V = dyn_cast<VariableDeclaration>(D)){
-        return new VariableAcccess(V);
+        return Context.createVariableAccess(V);
     } else if (auto *P = dyn_cast<FormalParameterDeclaration>(D)) {
-        return new VariableAcccess(P);
+        return Context.createVariableAccess(P);
     } else if (auto *C = dyn_cast<ConstantDeclaration>(D)){
         if ( C == TrueConst) {
             return TrueLiteral;
@@ -354,12 +352,12 @@ Expr *Sema::actOnVariable(Decl *D) {
         if (C == FalseConst){
             return FalseLiteral;
         }
-        return new ConstantAccess(C);
+        return Context.createConstantAccess(C);
     }
     return nullptr;
 }
 
-Expr *Sema::actOnFunctionCall(Decl *D, ExprList &Params){
+Expr *Sema::actOnFunctionCall(Decl *D, ExprList &&Params){
     if (!D) {
         return nullptr;
     }
@@ -368,21 +366,21 @@ Expr *Sema::actOnFunctionCall(Decl *D, ExprList &Params){
         if (!P->getReturnType()){
             Diags.report(D->getLocation(), diag::err_function_call_on_nonfunction);
         }
-        return new FunctionCallExpr(P, Params);
+        return Context.createFunctionCallExpr(P, Context.copyList(Params));
     }
     Diags.report(D->getLocation(), diag::err_function_call_on_nonfunction);
     return nullptr;
 }
 
-Decl *Sema::actOnQualIdentPart(Decl *Prev, SMLoc Loc, StringRef Name) {
+Decl *Sema::actOnQualIdentPart(Decl *Prev, SMLoc Loc, IdentifierInfo *Name) {
     if(!Prev) {
-        if (Decl *D = CurrentScope->lookup(Name)) {
+        if (Decl *D = CurrentScope.lookup(Name)) {
             return D;
         }
     } else if (auto *Mod = dyn_cast<ModuleDeclaration>(Prev)) {
         auto Decls = Mod->getDecls();
         for (auto I = Decls.begin(), E = Decls.end(); I != E; ++I ){
-            if ((*I)->getName() == Name){
+            if ((*I)->getIdentifier() == Name){
                 return *I;
             }
         }
@@ -390,6 +388,6 @@ Decl *Sema::actOnQualIdentPart(Decl *Prev, SMLoc Loc, StringRef Name) {
         llvm_unreachable("actionQualIdentPart only callable "
         "with module declarations");
     }
-    Diags.report(Loc, diag::err_undeclared_name, Name);
+    Diags.report(Loc, diag::err_undeclared_name, Name->getName());
     return nullptr;
 }
\ No newline at end of file
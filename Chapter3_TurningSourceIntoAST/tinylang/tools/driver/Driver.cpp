@@ -1,18 +1,24 @@
+#include "tinylang/AST/ASTContext.h"
 #include "tinylang/Basic/Diagnostic.h"
 #include "tinylang/Basic/Version.h"
 #include "tinylang/Parser/Parser.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/InitLLVM.h"
 #include "llvm/Support/raw_ostream.h"
 
 using namespace tinylang;
 
+static llvm::cl::list<std::string> InputFiles(llvm::cl::Positional, llvm::cl::desc("<input-files>"));
+
+static llvm::cl::opt<bool> PrintStats("print-stats", llvm::cl::desc("Print AST memory statistics for each file"));
+
 int main(int argc_, const char **argv_) {
     llvm::InitLLVM X(argc_, argv_);
-    llvm::SmallVector<const char *, 256> argv(argv_ + 1, argv_ + argc_);
+    llvm::cl::ParseCommandLineOptions(argc_, argv_, "tinylang - the Tinylang compiler\n");
 
     llvm::outs() << "Tinylang " << tinylang::getTinylangVersion() << "\n";
 
-    for (const char *F : argv) {
+    for (const std::string &F : InputFiles) {
         llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr = llvm::MemoryBuffer::getFile(F);
         if (std::error_code BufferError = FileOrErr.getError()) {
             llvm::errs() << "Error reading " << F << ": " << BufferError.message() << "\n";
@@ -25,9 +31,16 @@ int main(int argc_, const char **argv_) {
         // Tell SrcMgr about this buffer, which is what the parser will pick up.
         SrcMgr.AddNewSourceBuffer(std::move(*FileOrErr), llvm::SMLoc());
 
-        auto TheLexer = Lexer(SrcMgr, Diags);
-        auto TheSema = Sema(Diags);
+        // All AST nodes of this file are released at once with Context
+        IdentifierTable Idents;
+        ASTContext Context(Idents);
+        auto TheLexer = Lexer(SrcMgr, Diags, Idents);
+        auto TheSema = Sema(Diags, Context);
         auto TheParser = Parser(TheLexer, TheSema);
         TheParser.parse();
+        if (PrintStats) {
+            llvm::errs() << F << ":\n";
+            Context.printStats(llvm::errs());
+        }
     }
 }
\ No newline at end of file